@@ -131,7 +131,12 @@
 #define cmdToggleValidation     49
 #define cmdCopyFen              50
 #define cmdCreateNewPlayer      51
-#define cmdMax					52
+#define cmdSaveXt               52
+#define cmdLoadXt               53
+#define cmdAIThreadTest         54
+#define cmdAIMateTest           55
+#define cmdAIBatchTest          56
+#define cmdMax					57
 
 /*
  *	icons
@@ -284,6 +284,8 @@ public:
 	 *	but this'll need to change
 	 */
 
+	recursive_mutex mtxUI;	/* Direct2D is single-threaded, so drawing must be serialized
+							   with logging from the AI search thread */
 	void ClearLog(void) noexcept;
 	void InitLog(void) noexcept;
 	inline bool FDepthLog(LGT lgt, int& lgd) noexcept;
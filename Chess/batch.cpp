@@ -0,0 +1,136 @@
+/*
+ *
+ *	batch.cpp
+ *
+ *	Batch analysis of many positions across a pool of search threads
+ *
+ */
+
+#include "batch.h"
+
+
+/*	BATCH::BATCH
+ *
+ *	A batch analyzer with the given number of worker threads. Zero uses one
+ *	worker per hardware thread.
+ */
+BATCH::BATCH(int cthd) : cthd(cthd), pvszFen(nullptr), ifenNext(0), ifenEmit(0)
+{
+	if (this->cthd <= 0)
+		this->cthd = max((int)thread::hardware_concurrency(), 1);
+}
+
+
+/*	BATCH::Run
+ *
+ *	Searches all the positions in vszFen and calls pfnResult with each result,
+ *	in order. The callback is always called on the caller's thread, so it
+ *	doesn't need to worry about synchronization. Doesn't return until every
+ *	position has been searched.
+ */
+void BATCH::Run(const vector<string>& vszFen, function<void(const BATR&)> pfnResult)
+{
+	assert(batl.ttm != ttmInfinite);	/* the workers would never finish */
+
+	pvszFen = &vszFen;
+	ifenNext = ifenEmit = 0;
+	mpifenbatr.clear();
+
+	vector<thread> vthd;
+	for (int ithd = 0; ithd < cthd && ithd < (int)vszFen.size(); ithd++)
+		vthd.emplace_back(&BATCH::Worker, this);
+
+	while (ifenEmit < vszFen.size()) {
+		BATR batr;
+		{
+			unique_lock<mutex> lock(mtx);
+			cvResult.wait(lock, [this] { return mpifenbatr.find(ifenEmit) != mpifenbatr.end(); });
+			map<size_t, BATR>::iterator it = mpifenbatr.find(ifenEmit);
+			batr = move(it->second);
+			mpifenbatr.erase(it);
+			ifenEmit++;
+		}
+		cvWork.notify_all();
+		pfnResult(batr);
+	}
+
+	for (thread& thd : vthd)
+		thd.join();
+	pvszFen = nullptr;
+}
+
+
+/*	BATCH::Worker
+ *
+ *	The worker thread. Each worker has its own game and AI, and therefore its
+ *	own transposition table, eval cache, and history, and it doesn't log, so
+ *	workers share nothing but the work queue. The AI is reset between
+ *	positions so results don't depend on which worker happened to get which
+ *	positions. The transposition table is only allocated once per worker, and 
+ *	the reset just empties it, which is cheap at the batch table size.
+ */
+void BATCH::Worker(void)
+{
+	GA ga;
+	PLAI* pplai = new PLAI(ga);
+	ga.SetPl(cpcWhite, pplai);
+	pplai->EnableLog(false);
+	pplai->SetFecoRandom(0);
+	pplai->SetLevel(batl.level);
+	pplai->SetCmveLimit(batl.cmveLimit);
+	pplai->SetCbXt(batl.cbXt);
+
+	size_t ifen;
+	while (FNextFen(ifen)) {
+		BATR batr(ifen);
+		try {
+			const char* szFen = (*pvszFen)[ifen].c_str();
+			ga.InitGameFen(szFen, ga.prule);
+			ga.bdg.SetGs(gsPlaying);
+			pplai->SetTtm(batl.ttm);	/* search may have changed smart to time per move */
+			pplai->StartGame();
+			batr.mveBest = pplai->MveAnalyze(batr.vmvPV);
+			batr.cmve = pplai->CmveSearched();
+		}
+		catch (exception& ex) {
+			batr.szError = ex.what();
+		}
+		PostResult(move(batr));
+	}
+}
+
+
+/*	BATCH::FNextFen
+ *
+ *	Hands out the next position to a worker. Waits if the workers have gotten
+ *	too far ahead of the results the caller has picked up. Returns false when
+ *	there's no more work.
+ */
+bool BATCH::FNextFen(size_t& ifen)
+{
+	const size_t cfenAheadMax = 16 * (size_t)cthd;
+
+	unique_lock<mutex> lock(mtx);
+	cvWork.wait(lock, [this, cfenAheadMax] {
+		return ifenNext >= pvszFen->size() || ifenNext < ifenEmit + cfenAheadMax;
+	});
+	if (ifenNext >= pvszFen->size())
+		return false;
+	ifen = ifenNext++;
+	return true;
+}
+
+
+/*	BATCH::PostResult
+ *
+ *	Called by a worker when it's done with a position.
+ */
+void BATCH::PostResult(BATR&& batr)
+{
+	{
+		lock_guard<mutex> lock(mtx);
+		size_t ifen = batr.ifen;
+		mpifenbatr.emplace(ifen, move(batr));
+	}
+	cvResult.notify_one();
+}
@@ -0,0 +1,95 @@
+/*
+ *
+ *	batch.h
+ *
+ *	Batch analysis, which runs independent AI searches on a big list of
+ *	positions. There's no UI involved; each position is searched by one of a
+ *	pool of worker threads, each with its own game, AI, and transposition
+ *	table, so the workers never have to wait on each other.
+ *
+ */
+#pragma once
+#include "ga.h"
+
+
+/*
+ *
+ *	BATL - batch search limits, applied to every position. Batch searches can't
+ *	use the game clock, so smart time management turns into time per move.
+ *
+ *	Every worker has its own transposition table, and it's emptied for each 
+ *	position, so the default table is much smaller than a game's. The short
+ *	searches we typically do in batches don't fill a big one anyway.
+ *
+ */
+
+
+struct BATL
+{
+	TTM ttm;
+	int level;			/* search depth for constant depth, time for time per move */
+	uint64_t cmveLimit;	/* node budget for constant nodes, 0 to use the level */
+	uint32_t cbXt;		/* transposition table size for each worker */
+
+	BATL(TTM ttm = ttmConstDepth, int level = 5, uint64_t cmveLimit = 0, uint32_t cbXt = 4 * 0x100000UL) :
+		ttm(ttm), level(level), cmveLimit(cmveLimit), cbXt(cbXt)
+	{
+	}
+};
+
+
+/*
+ *
+ *	BATR - batch search result for one position
+ *
+ */
+
+
+struct BATR
+{
+	size_t ifen;		/* index of the position in the batch */
+	MVE mveBest;		/* best move, with its evaluation; nil if the position is over */
+	vector<MV> vmvPV;	/* principal variation, starting with the best move */
+	uint64_t cmve;		/* nodes searched, which is counted even in NOSTATS builds */
+	string szError;		/* non-empty if we couldn't search the position */
+
+	BATR(size_t ifen = 0) : ifen(ifen), mveBest(mvuNil, -evInf), cmve(0) { }
+};
+
+
+/*
+ *
+ *	BATCH
+ *
+ *	Searches every position in a list of FENs and hands the results back to the
+ *	caller in the same order as the positions, as soon as each one (and all the
+ *	ones before it) are done. Workers are only allowed to get so far ahead of
+ *	the results, so a slow position doesn't make us buffer up the whole batch.
+ *
+ */
+
+
+class BATCH
+{
+	int cthd;
+	BATL batl;
+
+	const vector<string>* pvszFen;
+	size_t ifenNext;	/* next position to hand out to a worker */
+	size_t ifenEmit;	/* next result to give back to the caller */
+	map<size_t, BATR> mpifenbatr;	/* finished results waiting to be given back */
+	mutex mtx;
+	condition_variable cvWork, cvResult;
+
+public:
+	BATCH(int cthd = 0);
+
+	void SetLimits(const BATL& batl) noexcept { this->batl = batl; }
+	int Cthd(void) const noexcept { return cthd; }
+	void Run(const vector<string>& vszFen, function<void(const BATR&)> pfnResult);
+
+private:
+	void Worker(void);
+	bool FNextFen(size_t& ifen);
+	void PostResult(BATR&& batr);
+};
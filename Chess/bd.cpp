@@ -302,6 +302,104 @@ HABD GENHABD::HabdFromBd(const BD& bd) const
 }
 
 
+/*	GENHABD::HabdSignature
+ *
+ *	Folds all the random keys into a single value that identifies the set of
+ *	keys we're hashing with. Anything saved with hashes (like a transposition
+ *	table file) can use this to detect that it was built with different keys.
+ */
+HABD GENHABD::HabdSignature(void) const
+{
+	HABD habdSig = habdMove;
+	auto Fold = [&habdSig](HABD habd) { habdSig = _rotl64(habdSig, 7) ^ habd; };
+	for (SQ sq = 0; sq < sqMax; sq++)
+		for (int pc = 0; pc < pcMax; pc++)
+			Fold(ahabdPiece[sq][pc]);
+	for (int cs = 0; cs < CArray(ahabdCastle); cs++)
+		Fold(ahabdCastle[cs]);
+	for (int file = 0; file < CArray(ahabdEnPassant); file++)
+		Fold(ahabdEnPassant[file]);
+	return habdSig;
+}
+
+
+/*	GENHABD::HabdAfterMv
+ *
+ *	Computes the hash of the board after the move is made, without actually 
+ *	making the move. This must be kept in sync with BD::MakeMvSq. Used to probe 
+ *	the transposition table for child positions before we commit to making 
+ *	the move.
+ */
+HABD GENHABD::HabdAfterMv(const BD& bd, MVE mve) const noexcept
+{
+	assert(!mve.fIsNil());
+	SQ sqFrom = mve.sqFrom();
+	SQ sqTo = mve.sqTo();
+	PC pcFrom = mve.pcMove();
+	CPC cpcFrom = pcFrom.cpc();
+	HABD habd = bd.habd;
+	int csNew = bd.csCur;
+	SQ sqEnPassantNew = sqNil;
+
+	/* captures */
+
+	SQ sqTake = sqTo;
+	if (pcFrom.apc() == apcPawn && sqTake == bd.sqEnPassant)
+		sqTake = SQ(sqTo.rank() ^ 1, bd.sqEnPassant.file());
+	if (!bd.FIsEmpty(sqTake)) {
+		APC apcTake = bd.ApcFromSq(sqTake);
+		habd ^= ahabdPiece[sqTake][PC(~cpcFrom, apcTake)];
+		if (apcTake == apcRook) {
+			if (sqTake == SQ(RankBackFromCpc(~cpcFrom), fileKingRook))
+				csNew &= ~(csKing << (int)~cpcFrom);
+			else if (sqTake == SQ(RankBackFromCpc(~cpcFrom), fileQueenRook))
+				csNew &= ~(csQueen << (int)~cpcFrom);
+		}
+	}
+
+	/* move the pieces */
+
+	PC pcTo = pcFrom;
+	switch (pcFrom.apc()) {
+	case apcPawn:
+		if (((sqFrom.rank() ^ sqTo.rank()) & 0x03) == 0x02)
+			sqEnPassantNew = SQ(sqTo.rank() ^ 1, sqTo.file());
+		else if (sqTo.rank() == 0 || sqTo.rank() == 7)
+			pcTo = PC(cpcFrom, mve.apcPromote());
+		break;
+
+	case apcKing:
+		csNew &= ~((csKing|csQueen) << (int)cpcFrom);
+		if (sqTo.file() - sqFrom.file() > 1)  // king side
+			habd ^= ahabdPiece[sqTo + 1][PC(cpcFrom, apcRook)] ^ ahabdPiece[sqTo - 1][PC(cpcFrom, apcRook)];
+		else if (sqTo.file() - sqFrom.file() < -1) // queen side
+			habd ^= ahabdPiece[sqTo - 2][PC(cpcFrom, apcRook)] ^ ahabdPiece[sqTo + 1][PC(cpcFrom, apcRook)];
+		break;
+
+	case apcRook:
+		if (sqFrom == SQ(RankBackFromCpc(cpcFrom), fileQueenRook))
+			csNew &= ~(csQueen << (int)cpcFrom);
+		else if (sqFrom == SQ(RankBackFromCpc(cpcFrom), fileKingRook))
+			csNew &= ~(csKing << (int)cpcFrom);
+		break;
+
+	default:
+		break;
+	}
+	habd ^= ahabdPiece[sqFrom][pcFrom] ^ ahabdPiece[sqTo][pcTo];
+
+	/* castle, en passant, and side to move */
+
+	if (csNew != bd.csCur)
+		habd ^= ahabdCastle[bd.csCur] ^ ahabdCastle[csNew];
+	if (!bd.sqEnPassant.fIsNil())
+		habd ^= ahabdEnPassant[bd.sqEnPassant.file()];
+	if (!sqEnPassantNew.fIsNil())
+		habd ^= ahabdEnPassant[sqEnPassantNew.file()];
+	return habd ^ habdMove;
+}
+
+
 /*
  *
  *	mpbb
@@ -164,6 +164,8 @@ public:
 	GENHABD(void);
 	HABD HabdRandom(mt19937_64& rgen);
 	HABD HabdFromBd(const BD& bd) const;
+	HABD HabdSignature(void) const;
+	HABD HabdAfterMv(const BD& bd, MVE mve) const noexcept;
 
 	
 	/*	HABD::TogglePiece
@@ -457,6 +459,14 @@ public:
 		return bbUnoccupied.fSet(sq);
 	}
 
+	/* true if the side has any pieces other than pawns and the king; positions
+	   without them are where zugzwang usually shows up */
+	inline bool FHasNonPawnMaterial(CPC cpc) const noexcept
+	{
+		return mppcbb[PC(cpc, apcKnight)] || mppcbb[PC(cpc, apcBishop)] ||
+			mppcbb[PC(cpc, apcRook)] || mppcbb[PC(cpc, apcQueen)];
+	}
+
 	inline bool FCanCastle(CPC cpc, int csSide) const noexcept
 	{
 		return (csCur & (csSide << (int)cpc)) != 0;
@@ -52,6 +52,10 @@
 #include <fstream>
 #include <filesystem>
 #include <streambuf>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 
 using namespace D2D1;
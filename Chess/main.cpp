@@ -9,6 +9,7 @@
 #include "app.h"
 #include "uiga.h"
 #include "ga.h"
+#include "batch.h"
 #include "dlg.h"
 
 
@@ -603,11 +604,13 @@ bool APP::OnTimer(UINT tid)
 
 void APP::ClearLog(void) noexcept
 {
+    lock_guard<recursive_mutex> lock(mtxUI);
     puiga->uidb.ClearLog();
 }
 
 void APP::InitLog(void) noexcept
 {
+    lock_guard<recursive_mutex> lock(mtxUI);
     puiga->uidb.InitLog();
 }
 
@@ -618,6 +621,7 @@ bool APP::FDepthLog(LGT lgt, int& depth) noexcept
 
 void APP::AddLog(LGT lgt, LGF lgf, int lgd, const TAG& tag, const wstring& szData) noexcept
 {
+    lock_guard<recursive_mutex> lock(mtxUI);
     return puiga->uidb.AddLog(lgt, lgf, lgd, tag, szData);
 }
 
@@ -1043,6 +1047,256 @@ public:
 };
 
 
+/*
+ *
+ *  CMDAITHREADTEST
+ * 
+ *  Multithreaded search scaling benchmark. Searches a set of test positions to
+ *  a fixed depth with different numbers of search threads, and reports the 
+ *  time to depth and nodes per second for each thread count.
+ * 
+ */
+
+
+class CMDAITHREADTEST : public CMD
+{
+public:
+    CMDAITHREADTEST(APP& app, int icmd) : CMD(app, icmd) {}
+
+    virtual int Execute(void)
+    {
+        static const int acthd[] = { 1, 2, 4, 8, 16, 32 };
+        static const wchar_t* aszFile[] = {
+            L"..\\Chess\\Test\\Win-At-Chess-New.epd",
+            L"..\\Chess\\Test\\BK-Test.epd"
+        };
+        const int cepdPerFile = 8;
+        const int dBench = 7;
+
+        /* read the test positions */
+
+        vector<string> vszEpd;
+        for (const wchar_t* szFile : aszFile) {
+            ifstream is(szFile, ifstream::in);
+            string szEpd;
+            for (int iepd = 0; iepd < cepdPerFile && getline(is, szEpd); )
+                if (!szEpd.empty()) {
+                    vszEpd.push_back(szEpd);
+                    iepd++;
+                }
+        }
+        if (vszEpd.empty()) {
+            app.Error(L"No EPD test files found", MB_OK);
+            return 1;
+        }
+
+        for (CPC cpc = cpcWhite; cpc < cpcMax; ++cpc) {
+            PL* ppl = app.puiga->ga.PplFromCpc(cpc);
+            if (ppl->FHasLevel())
+                ppl->SetLevel(dBench);
+            ppl->SetTtm(ttmConstDepth);
+            ppl->SetFecoRandom(0);
+        }
+        app.puiga->InitGameEpd(vszEpd[0].c_str(), nullptr);
+        app.puiga->ga.prule->SetGameTime(cpcWhite, 0);
+        app.puiga->ga.prule->SetGameTime(cpcBlack, 0);
+        app.puiga->uiml.ShowClocks(false);
+        app.puiga->StartGame(spmvFast);
+
+        ClearLog();
+        LogOpen(L"AI Thread Test", wjoin(vszEpd.size(), L"positions, depth", dBench), lgfBold);
+        int lgdSav = LgdShow();
+        SetLgdShow(1);
+
+        uint64_t usBase = 0;
+        for (int cthd : acthd) {
+            uint64_t us = 0, cmve = 0;
+            for (const string& szEpd : vszEpd) {
+                app.puiga->InitGameEpd(szEpd.c_str(), nullptr);
+                app.puiga->ga.bdg.SetGs(gsPlaying);
+                PL* ppl = app.puiga->ga.PplToMove();
+                ppl->SetCthd(cthd);
+                ppl->StartGame();
+                SPMV spmv = spmvFast;
+                time_point<high_resolution_clock> tpStart = high_resolution_clock::now();
+                ppl->MveGetNext(spmv);
+                us += duration_cast<microseconds>(high_resolution_clock::now() - tpStart).count();
+                cmve += ppl->CmveSearched();
+            }
+            if (cthd == 1)
+                usBase = us;
+            LogData(wjoin(L"Threads:", cthd,
+                          L"Time:", SzCommaFromLong(us / 1000), L"ms",
+                          L"NPS:", SzCommaFromLong(cmve * 1000000 / max(us, 1ULL)),
+                          L"Speedup:", to_wstring((double)usBase / (double)max(us, 1ULL))));
+        }
+
+        for (CPC cpc = cpcWhite; cpc < cpcMax; ++cpc)
+            app.puiga->ga.PplFromCpc(cpc)->SetCthd(1);
+        SetLgdShow(lgdSav);
+        LogClose(L"AI Thread Test", L"", lgfBold);
+
+        return 1;
+    }
+};
+
+
+/*
+ *
+ *  CMDAIMATETEST
+ * 
+ *  Compares the proof-number mate solver against the regular AI. For each test
+ *  position, we look for a mate with the solver, and when it finds one, we
+ *  time how long the AI takes to find a mate in the same position.
+ * 
+ */
+
+
+class CMDAIMATETEST : public CMD
+{
+public:
+    CMDAIMATETEST(APP& app, int icmd) : CMD(app, icmd) {}
+
+    virtual int Execute(void)
+    {
+        const int cepdMax = 50;
+        const int cmvMate = 5;
+
+        vector<string> vszEpd;
+        ifstream is(L"..\\Chess\\Test\\Win-At-Chess-New.epd", ifstream::in);
+        string szEpd;
+        while ((int)vszEpd.size() < cepdMax && getline(is, szEpd))
+            if (!szEpd.empty())
+                vszEpd.push_back(szEpd);
+        if (vszEpd.empty()) {
+            app.Error(L"No EPD test files found", MB_OK);
+            return 1;
+        }
+
+        for (CPC cpc = cpcWhite; cpc < cpcMax; ++cpc) {
+            PL* ppl = app.puiga->ga.PplFromCpc(cpc);
+            if (ppl->FHasLevel())
+                ppl->SetLevel(2 * cmvMate);
+            ppl->SetTtm(ttmConstDepth);
+            ppl->SetFecoRandom(0);
+        }
+        app.puiga->InitGameEpd(vszEpd[0].c_str(), nullptr);
+        app.puiga->ga.prule->SetGameTime(cpcWhite, 0);
+        app.puiga->ga.prule->SetGameTime(cpcBlack, 0);
+        app.puiga->uiml.ShowClocks(false);
+        app.puiga->StartGame(spmvFast);
+
+        ClearLog();
+        LogOpen(L"AI Mate Test", wjoin(vszEpd.size(), L"positions, mate in", cmvMate), lgfBold);
+        int lgdSav = LgdShow();
+        SetLgdShow(1);
+
+        PNS pns;
+        pns.cmvMateMax = cmvMate;
+        pns.dmsecMax = 10 * msecSec;
+        int cpnsMate = 0, caiMate = 0;
+        uint64_t usPns = 0, usAI = 0;
+        for (int iepd = 0; iepd < (int)vszEpd.size(); iepd++) {
+            app.puiga->InitGameEpd(vszEpd[iepd].c_str(), nullptr);
+            app.puiga->ga.bdg.SetGs(gsPlaying);
+            if (!pns.FSolve(app.puiga->ga.bdg)) {
+                LogData(wjoin(iepd + 1, L"Solver:", to_wstring(pns.pnsr), SzCommaFromLong(pns.dmsecSolve), L"ms"));
+                continue;
+            }
+            cpnsMate++;
+            usPns += pns.dmsecSolve * 1000ULL;
+
+            PL* ppl = app.puiga->ga.PplToMove();
+            ppl->StartGame();
+            SPMV spmv = spmvFast;
+            time_point<high_resolution_clock> tpStart = high_resolution_clock::now();
+            MVE mve = ppl->MveGetNext(spmv);
+            uint64_t us = duration_cast<microseconds>(high_resolution_clock::now() - tpStart).count();
+            bool fAIMate = FEvIsMate(mve.ev);
+            if (fAIMate) {
+                caiMate++;
+                usAI += us;
+            }
+            LogData(wjoin(iepd + 1, L"Solver: mate in", (pns.vmvMate.size() + 1) / 2, 
+                          SzCommaFromLong(pns.dmsecSolve), L"ms",
+                          L"AI:", fAIMate ? L"mate" : L"missed", SzCommaFromLong(us / 1000), L"ms"));
+        }
+
+        SetLgdShow(lgdSav);
+        LogData(wjoin(L"Solver mates:", cpnsMate, L"Time:", SzCommaFromLong(usPns / 1000), L"ms"));
+        LogData(wjoin(L"AI mates:", caiMate, L"Time:", SzCommaFromLong(usAI / 1000), L"ms"));
+        LogClose(L"AI Mate Test", L"", lgfBold);
+
+        return 1;
+    }
+};
+
+
+/*
+ *
+ *  CMDAIBATCHTEST
+ * 
+ *  Batch analysis throughput benchmark. Runs the test positions through the 
+ *  batch analyzer with one worker and then with a worker per core, and reports
+ *  positions per second and the speedup.
+ * 
+ */
+
+
+class CMDAIBATCHTEST : public CMD
+{
+public:
+    CMDAIBATCHTEST(APP& app, int icmd) : CMD(app, icmd) {}
+
+    virtual int Execute(void)
+    {
+        const int dBatch = 6;
+
+        vector<string> vszFen;
+        ifstream is(L"..\\Chess\\Test\\Win-At-Chess-New.epd", ifstream::in);
+        string szEpd;
+        while (getline(is, szEpd))
+            if (!szEpd.empty())
+                vszFen.push_back(szEpd);
+        if (vszFen.empty()) {
+            app.Error(L"No EPD test files found", MB_OK);
+            return 1;
+        }
+
+        ClearLog();
+        LogOpen(L"AI Batch Test", wjoin(vszFen.size(), L"positions, depth", dBatch), lgfBold);
+        int lgdSav = LgdShow();
+        SetLgdShow(1);
+
+        uint64_t usBase = 0;
+        for (int cthd : { 1, 0 }) {
+            BATCH batch(cthd);
+            batch.SetLimits(BATL(ttmConstDepth, dBatch));
+            uint64_t cmve = 0;
+            time_point<high_resolution_clock> tpStart = high_resolution_clock::now();
+            batch.Run(vszFen, [&cmve](const BATR& batr) {
+                cmve += batr.cmve;
+                if (!batr.szError.empty())
+                    LogData(wjoin(batr.ifen + 1, L"Error:", wstring(batr.szError.begin(), batr.szError.end())));
+            });
+            uint64_t us = max((uint64_t)duration_cast<microseconds>(high_resolution_clock::now() - tpStart).count(), 1ULL);
+            if (cthd == 1)
+                usBase = us;
+            LogData(wjoin(L"Threads:", batch.Cthd(),
+                          L"Time:", SzCommaFromLong(us / 1000), L"ms",
+                          L"Positions/sec:", to_wstring((double)vszFen.size() * 1000000.0 / (double)us),
+                          L"NPS:", SzCommaFromLong(cmve * 1000000 / us),
+                          L"Speedup:", to_wstring((double)usBase / (double)us)));
+        }
+
+        SetLgdShow(lgdSav);
+        LogClose(L"AI Batch Test", L"", lgfBold);
+
+        return 1;
+    }
+};
+
+
 /*
  *
  *  CMDAIBREAK
@@ -1306,6 +1560,107 @@ public:
 };
 
 
+/*
+ *
+ *  CMDSAVEXT and CMDLOADXT
+ *
+ *  Commands to save and reload an AI player's transposition table, so long
+ *  analysis sessions can be resumed without rebuilding the table from scratch.
+ *  Works on the AI player to move, or the other player if that's not an AI.
+ *
+ */
+
+
+static PL* PplXt(APP& app)
+{
+    PL* ppl = app.pga->PplToMove();
+    if (ppl->FHasXt())
+        return ppl;
+    ppl = app.pga->PplFromCpc(~app.pga->bdg.cpcToMove);
+    return ppl->FHasXt() ? ppl : nullptr;
+}
+
+
+class CMDSAVEXT : public CMD
+{
+public:
+    CMDSAVEXT(APP& app, int icmd) : CMD(app, icmd) {}
+
+    virtual int Execute(void)
+    {
+        PL* ppl = PplXt(app);
+        if (ppl == nullptr)
+            return 1;
+
+        wchar_t szFileName[1024] = L"analysis.xt";
+        OPENFILENAME ofn = { 0 };
+        ofn.lStructSize = sizeof(OPENFILENAME);
+        ofn.hwndOwner = app.hwnd;
+        ofn.lpstrFilter = L"Transposition Tables\0*.xt\0\0";
+        ofn.lpstrFile = szFileName;
+        ofn.nMaxFile = CArray(szFileName);
+        ofn.lpstrTitle = L"Save Transposition Table";
+        ofn.Flags = OFN_HIDEREADONLY | OFN_OVERWRITEPROMPT | OFN_PATHMUSTEXIST;
+        ofn.lpstrDefExt = L"xt";
+        if (!::GetSaveFileName(&ofn))
+            return 1;
+
+        try {
+            ppl->SaveXtFile(szFileName);
+        }
+        catch (exception& ex) {
+            app.Error(ex.what(), MB_OK);
+        }
+        return 1;
+    }
+
+    virtual bool FEnabled(void) const
+    {
+        return PplXt(app) != nullptr;
+    }
+};
+
+
+class CMDLOADXT : public CMD
+{
+public:
+    CMDLOADXT(APP& app, int icmd) : CMD(app, icmd) {}
+
+    virtual int Execute(void)
+    {
+        PL* ppl = PplXt(app);
+        if (ppl == nullptr)
+            return 1;
+
+        wchar_t szFileName[1024] = { 0 };
+        OPENFILENAME ofn = { 0 };
+        ofn.lStructSize = sizeof(OPENFILENAME);
+        ofn.hwndOwner = app.hwnd;
+        ofn.lpstrFilter = L"Transposition Tables\0*.xt\0\0";
+        ofn.lpstrFile = szFileName;
+        ofn.nMaxFile = CArray(szFileName);
+        ofn.lpstrTitle = L"Load Transposition Table";
+        ofn.Flags = OFN_HIDEREADONLY | OFN_PATHMUSTEXIST | OFN_FILEMUSTEXIST;
+        ofn.lpstrDefExt = L"xt";
+        if (!::GetOpenFileName(&ofn))
+            return 1;
+
+        try {
+            ppl->LoadXtFile(szFileName);
+        }
+        catch (exception& ex) {
+            app.Error(ex.what(), MB_OK);
+        }
+        return 1;
+    }
+
+    virtual bool FEnabled(void) const
+    {
+        return PplXt(app) != nullptr;
+    }
+};
+
+
 /*
  *
  *  CMDCOPY
@@ -1939,6 +2294,9 @@ void APP::InitCmdList(void)
     vcmd.Add(new CMDPERFTDIVIDE(*this, cmdPerftDivideGo, false));
     vcmd.Add(new CMDSHOWPIECEVALUES(*this, cmdShowPieceValues));
     vcmd.Add(new CMDAISPEEDTEST(*this, cmdAISpeedTest));
+    vcmd.Add(new CMDAITHREADTEST(*this, cmdAIThreadTest));
+    vcmd.Add(new CMDAIMATETEST(*this, cmdAIMateTest));
+    vcmd.Add(new CMDAIBATCHTEST(*this, cmdAIBatchTest));
     vcmd.Add(new CMDAIBREAK(*this, cmdAIBreak));
     vcmd.Add(new CMDLINKUCI(*this, cmdLinkUCI));
     vcmd.Add(new CMDTIMECONTROL(*this, cmdClockBullet_1_0, 1*60, 0));
@@ -1960,6 +2318,8 @@ void APP::InitCmdList(void)
     vcmd.Add(new CMDTOGGLEVALIDATION(*this, cmdToggleValidation));
     vcmd.Add(new CMDCOPYFEN(*this, cmdCopyFen));
     vcmd.Add(new CMDCREATENEWPLAYER(*this, cmdCreateNewPlayer));
+    vcmd.Add(new CMDSAVEXT(*this, cmdSaveXt));
+    vcmd.Add(new CMDLOADXT(*this, cmdLoadXt));
 }
 
 
@@ -12,12 +12,69 @@
 #include "debug.h"
 #include "Resources/Resource.h"
 
-/* these must be powers of two */
-#ifndef NDEBUG
-const uint16_t dcYield = 8;
-#else
-const uint16_t dcYield = 2048;
-#endif
+const int cthdMax = 32;	/* maximum number of search threads */
+
+
+/*
+ *
+ *	LMR
+ * 
+ *	Late move reduction table. The amount we reduce the search depth of a late
+ *	quiet move, indexed by the remaining depth and the move number. Reductions 
+ *	grow with log(depth) * log(move number).
+ * 
+ */
+
+
+class LMR
+{
+public:
+	static const int dLmrMax = 64;
+	static const int cmvLmrMax = 64;
+	int8_t mpdcmvdReduce[dLmrMax][cmvLmrMax];
+
+	LMR(void) noexcept
+	{
+		for (int d = 0; d < dLmrMax; d++)
+			for (int cmv = 0; cmv < cmvLmrMax; cmv++)
+				mpdcmvdReduce[d][cmv] = (d == 0 || cmv == 0) ? 0 : 
+					(int8_t)(0.75 + log((double)d) * log((double)cmv) / 2.25);
+	}
+
+	inline int DReduce(int d, int cmv) const noexcept
+	{
+		return mpdcmvdReduce[min(d, dLmrMax - 1)][min(cmv, cmvLmrMax - 1)];
+	}
+};
+
+static const LMR lmr;
+
+
+/*	FLosingCapture
+ *
+ *	Our stand-in for a negative static exchange evaluation. Captures are scored 
+ *	by ScoreCapture during move ordering, and any that scored below zero probably
+ *	lose material.
+ */
+static inline bool FLosingCapture(const MVE& mve) noexcept
+{
+	return mve.tsc() == tscBadCapture || (mve.tsc() == tscGoodCapture && mve.ev < 0);
+}
+
+
+/* futility margins, indexed by remaining search depth */
+
+EV mpdddevFutility[9] = {
+	0,
+	100, 
+	160, 
+	220, 
+	280, 
+	340, 
+	400, 
+	460, 
+	520
+};
 
 
 /*
@@ -141,9 +198,10 @@ public:
  */
 
 
-PLAI::PLAI(GA& ga) : PL(ga, L"AI"), rgen(372716661UL), habdRand(0), 
-		ttm(IfReleaseElse(ttmSmart, ttmConstDepth)), level(3),
-		cYield(0), dSel(0)
+PLAI::PLAI(GA& ga) : PL(ga, L"AI"), rgen(372716661UL), habdRand(0), xt(xtOwn), cbXt(64 * 0x100000UL),
+		ttm(IfReleaseElse(ttmSmart, ttmConstDepth)), level(3), sint(sintNull), fBestOverall(false),
+		cmveLimit(0), dLimit(0), cmveDeadline(0), cmveMove(0), fPonder(false), dmsecPonder(0), dmsecPreSearch(0), cmveCheck(1), lgcmveCheck(10), 
+		dmsecMoveOverhead(30), dmsecLatency(0), dSel(0), cmvPVRoot(0), cpvMulti(1), cpvMultiCur(0), dPvMulti(0), imveRoot(0), fHelper(false), fLog(true), cthd(1)
 {
 	fecoPsqt = 1*fecoScale;
 	fecoMaterial = 0*fecoScale;
@@ -152,8 +210,35 @@ PLAI::PLAI(GA& ga) : PL(ga, L"AI"), rgen(372716661UL), habdRand(0),
 	fecoPawnStructure = 10*fecoScale;
 	fecoTempo = 1*fecoScale;
 	fecoRandom = 0*fecoScale;
+	devProbCut = 200;
 	InitWeightTables();
 }
+
+
+/*	PLAI::PLAI
+ *
+ *	Constructor for a helper search thread. Helpers share the main AI's 
+ *	transposition table, and pick up the main AI's evaluation state every
+ *	time a search starts.
+ */
+PLAI::PLAI(PLAI& plaiMain) : PL(plaiMain.ga, L"AI Helper"), rgen(372716661UL), habdRand(0), 
+		xt(plaiMain.xt), cbXt(0), ttm(plaiMain.ttm), level(plaiMain.level), sint(sintNull), fBestOverall(false),
+		cmveLimit(0), dLimit(0), cmveDeadline(0), cmveMove(0), fPonder(false), dmsecPonder(0), dmsecPreSearch(0), cmveCheck(1), lgcmveCheck(10), 
+		dmsecMoveOverhead(30), dmsecLatency(0), dSel(0), cmvPVRoot(0), cpvMulti(1), cpvMultiCur(0), dPvMulti(0), imveRoot(0), fHelper(true), fLog(false), cthd(1)
+{
+	fecoPsqt = fecoMaterial = fecoMobility = fecoKingSafety = 0;
+	fecoPawnStructure = fecoTempo = fecoRandom = 0;
+	devProbCut = plaiMain.devProbCut;
+	StartGame();
+}
+
+
+PLAI::~PLAI(void)
+{
+	StopHelpers();
+	for (PLAI* pplai : vpplaiHelper)
+		delete pplai;
+}
  
 
 /*	PLAI::FHasLevel
@@ -182,17 +267,121 @@ void PLAI::SetTtm(TTM ttm) noexcept
 }
 
 
-void PLAI::StartGame(void)
+/*	PLAI::SetCmveLimit
+ *
+ *	Sets the number of nodes searched by constant nodes time management. Zero
+ *	uses a budget based on the level.
+ */
+void PLAI::SetCmveLimit(uint64_t cmveLimit) noexcept
 {
-	xt.Init(64 * 0x100000UL);
+	this->cmveLimit = cmveLimit;
+}
 
-	/* initialize killers */
 
-	for (int imvGame = 0; imvGame < 256; imvGame++)
-		for (int imv = 0; imv < cmvKillers; imv++)
-			amvKillers[imvGame][imv] = mvNil;
+/*	PLAI::SetDLimit
+ *
+ *	Sets the search depth for constant depth time management. Unlike the 
+ *	level, this isn't limited to the levels the UI offers. Zero uses a depth
+ *	based on the level.
+ */
+void PLAI::SetDLimit(int dLimit) noexcept
+{
+	this->dLimit = dLimit ? clamp(dLimit, 1, dMax / 2) : 0;
+}
+
+
+/*	PLAI::SetDmsecMoveOverhead
+ *
+ *	Sets the time we allow for the move to get from us to the clock, which 
+ *	comes off our time budget on every move.
+ */
+void PLAI::SetDmsecMoveOverhead(DWORD dmsecMoveOverhead) noexcept
+{
+	this->dmsecMoveOverhead = min(dmsecMoveOverhead, (DWORD)(5*msecSec));
+}
+
+
+/*	PLAI::SetCpvMulti
+ *
+ *	Sets the number of MultiPV lines the AI searches for.
+ */
+void PLAI::SetCpvMulti(int cpvMulti) noexcept
+{
+	this->cpvMulti = clamp(cpvMulti, 1, cpvMultiMax);
+}
+
+
+/*	PLAI::SetDevProbCut
+ *
+ *	Sets the ProbCut margin, which is how far above beta a capture's reduced
+ *	search has to get before we take the cut. Bigger margins are safer but 
+ *	cut less.
+ */
+void PLAI::SetDevProbCut(EV devProbCut) noexcept
+{
+	this->devProbCut = clamp(devProbCut, (EV)0, (EV)(10*evPawn));
+}
+
+
+/*	PLAI::SetCthd
+ *
+ *	Sets the number of threads the AI uses to search.
+ */
+void PLAI::SetCthd(int cthd) noexcept
+{
+	this->cthd = clamp(cthd, 1, cthdMax);
+	while ((int)vpplaiHelper.size() > this->cthd - 1) {
+		delete vpplaiHelper.back();
+		vpplaiHelper.pop_back();
+	}
+}
+
+
+/*	PLAI::CmveSearched
+ *
+ *	Number of nodes searched on the last move, including all search threads.
+ */
+uint64_t PLAI::CmveSearched(void) const noexcept
+{
+	return cmveMove;
+}
+
+
+void PLAI::StartGame(void)
+{
+	if (!fHelper)
+		xt.Init(cbXt);	/* 64MB by default, which is 4M 16-byte entries */
+	evc.Clear();
+#ifndef NOSTATS
+	xts.Clear();
+#endif
 
+	InitSs(false);
 	InitHistory();
+	for (PLAI* pplai : vpplaiHelper)
+		pplai->StartGame();
+}
+
+
+/*	PLAI::SaveXtFile
+ *
+ *	Saves the AI's transposition table to a file, so a long analysis can be
+ *	picked up again later. Throws an exception on errors.
+ */
+void PLAI::SaveXtFile(const wstring& szFile)
+{
+	xt.SaveFile(szFile);
+}
+
+
+/*	PLAI::LoadXtFile
+ *
+ *	Reloads the transposition table from a file saved with SaveXtFile. The
+ *	saved table must be compatible with ours or we throw an exception.
+ */
+void PLAI::LoadXtFile(const wstring& szFile)
+{
+	xt.LoadFile(szFile);
 }
 
 
@@ -204,6 +393,17 @@ void PLAI::StartGame(void)
 void PLAI::StartMoveLog(void)
 {
 	stbfMainTotal.Init(); stbfMainAndQTotal.Init();
+#ifndef NOSTATS
+	cmvLmr = cmvLmrResearch = 0;
+	cmvPruneMoveCount = cmvPruneFutility = 0;
+	cmvCut = cmvCutFirst = 0;
+	cbdIir = cbdProbCut = 0;
+	cbdNullVerify = cbdNullVerifyFail = 0;
+	cTimeMan = dnsecTimeMan = 0;
+	xt.ClearStats();
+#endif
+	if (!fLog)
+		return;
 	LogOpen(TAG(wjoin(to_wstring(ga.bdg.vmveGame.size()/2+1) + L".", ga.bdg.cpcToMove),  
 				ATTR(L"FEN", ga.bdg)),
 			L"(" + szName + L")", lgfBold);
@@ -216,44 +416,60 @@ void PLAI::StartMoveLog(void)
  */
 void PLAI::EndMoveLog(void)
 {
+	if (!fLog)
+		return;
 #ifndef NOSTATS
 	time_point<high_resolution_clock> tpEnd = high_resolution_clock::now();
 	/* cache stats */
-	LogData(wjoin(L"Cache Fill:", SzPercent(xt.cxevInUse, xt.cxevMax)));
-	LogData(wjoin(L"Cache Probe Hit:", SzPercent(xt.cxevProbeHit, xt.cxevProbe)));
-	LogData(wjoin(L"Cache Save Replace:", SzPercent(xt.cxevSaveReplace, xt.cxevSave)));
-	LogData(wjoin(L"Cache Save Collision:", SzPercent(xt.cxevSaveCollision, xt.cxevSave)));
+	LogData(wjoin(L"Cache Fill:", SzPercent(xt.CxevInUse(), xt.cxevMax)));
+	LogData(wjoin(L"Cache Probe Hit:", SzPercent(xts.cxevProbeHit, xts.cxevProbe)));
+	LogData(wjoin(L"Cache Save Replace:", SzPercent(xts.cxevSaveReplace, xts.cxevSave)));
+	LogData(wjoin(L"Cache Save Collision:", SzPercent(xts.cxevSaveCollision, xts.cxevSave)));
+	LogData(wjoin(L"Static Evals Avoided:", SzPercent(xts.cxevProbeEvStaticHit, xts.cxevProbeEvStatic)));
+	LogData(wjoin(L"Eval Cache Hit:", SzPercent(evc.cevcProbeHit, evc.cevcProbe)));
 
 	/* time stats */
 	duration dtp = tpEnd - tpMoveStart;
 	milliseconds ms = duration_cast<milliseconds>(dtp);
 	LogData(wjoin(L"Branch factor:", (wstring)stbfMainTotal));
+	LogData(wjoin(L"Quiescent branch factor:", (wstring)stbfMainAndQTotal));
+	LogData(wjoin(L"Main+Quiescent nodes:", SzCommaFromLong(stbfMainAndQTotal.cmveNode)));
+	LogData(wjoin(L"Effective branch factor:", stbfMain.SzEbf(stbfMainPrev)));
+	LogData(wjoin(L"Late Move Reductions:", cmvLmr));
+	LogData(wjoin(L"LMR Re-search:", SzPercent(cmvLmrResearch, cmvLmr)));
+	LogData(wjoin(L"Move Count Pruned:", cmvPruneMoveCount));
+	LogData(wjoin(L"Move Futility Pruned:", cmvPruneFutility));
+	LogData(wjoin(L"First Move Cut-offs:", SzPercent(cmvCutFirst, cmvCut)));
+	LogData(wjoin(L"IIR Reductions:", cbdIir));
+	LogData(wjoin(L"ProbCut Prunes:", cbdProbCut));
+	LogData(wjoin(L"Null Move Verify Failed:", SzPercent(cbdNullVerifyFail, cbdNullVerify)));
+	LogData(wjoin(L"Time Checks:", SzCommaFromLong(cTimeMan), 
+				  L"Overhead:", SzPercent(dnsecTimeMan, (uint64_t)ms.count() * 1000000)));
 #endif
 	LogClose(L"", L"", lgfNormal);
 }
 
 
-void PLAI::BuildPvSz(BDG& bdg, wstring& sz)
+/*	PLAI::BuildPvSz
+ *
+ *	Builds the text of the principal variation from the last completed 
+ *	iteration. ipv is the MultiPV line.
+ */
+void PLAI::BuildPvSz(wstring& sz, int ipv) const
 {
-	XEV* pxev = xt.Find(bdg, 0, 0);
-	if (pxev == nullptr || pxev->fVisited())
-		return;
-	MVE mve = bdg.MveFromMv(pxev->mv());
-	sz += L" " + to_wstring(mve);
-	if (mve.fIsNil())
-		return;
-	pxev->SetFVisited(true);
-	bdg.MakeMv(mve);
-	BuildPvSz(bdg, sz);
-	bdg.UndoMv();
-	pxev->SetFVisited(false);
+	const MV* amv = ipv == 0 ? amvPVRoot : amvPVMulti[ipv];
+	int cmv = ipv == 0 ? cmvPVRoot : acmvPVMulti[ipv];
+	for (int imv = 0; imv < cmv; imv++)
+		sz += L" " + to_wstring(amv[imv]);
 }
 
 
-void PLAI::LogInfo(BDG& bdg, EV ev, int d, int dSel)
+void PLAI::LogInfo(BDG& bdg, EV ev, int d, int dSel, int ipv)
 {
+	if (!fLog)
+		return;
 	wstring sz;
-	BuildPvSz(bdg, sz);
+	BuildPvSz(sz, ipv);
 	/* TODO: hashfull. */
 	DWORD dmsec = DmsecMoveSoFar();
 	bool fMate = FEvIsMate(abs(ev));
@@ -263,19 +479,21 @@ void PLAI::LogInfo(BDG& bdg, EV ev, int d, int dSel)
 		if (ev < 0)
 			evScore = -evScore;
 	}
-	LogData(wjoin(L"info", 
+	LogData(wjoin(cpvMulti > 1 ? wjoin(L"info multipv", ipv + 1) : wstring(L"info"), 
 				  L"score", fMate ? L"mate" : L"cp", evScore,
 				  L"depth", d,
 				  L"seldepth", dSel,
-				  L"nodes", stbfMainAndQTotal.cmveNode,
+				  L"nodes", CmveMoveSoFar(),
 				  L"time", dmsec,
-				  L"nps", stbfMainAndQTotal.cmveNode * 1000 / dmsec,
+				  L"nps", CmveMoveSoFar() * 1000 / max(dmsec, 1UL),
 				  L"pv", sz));
 }
 
 
 void PLAI::LogBestMove(BDG& bdg, MVE mveBest, int d, int dSel)
 {
+	if (!fLog)
+		return;
 	LogInfo(bdg, mveBest.ev, d, dSel);
 	LogData(wjoin(L"bestmove", to_wstring(mveBest)));
 }
@@ -332,25 +550,26 @@ public:
 		LOGSEARCH(pl, bdg), AIBREAK(pl, mvePrev, d),
 		mvePrev(mvePrev), mveBest(mveBest), abInit(-ab), lgdSav(0), imvExpandSav(0)
 	{
+		/* helper search threads don't log */
+		if (!pl.fLog)
+			return;
 		lgdSav = LgdShow();
 		imvExpandSav = imvExpand;
 		if (FExpandLog(mvePrev))
 			SetLgdShow(lgdSav + 1);
 		int lgd;
-		if (!papp->FDepthLog(lgtOpen, lgd))
-			pl.PumpMsg(false);
-		else {
-			pl.PumpMsg(true);
+		if (papp->FDepthLog(lgtOpen, lgd))
 			papp->AddLog(lgtOpen, lgfNormal, lgd,
 						 TAG(bdg.SzDecodeMvPost(mvePrev), ATTR(L"FEN", bdg)),
 						 wjoin(wstring(1, chType) + to_wstring(d),
 							   to_wstring(mvePrev.tsc()),
 							   SzFromEv(mvePrev.ev), abInit));
-		}
 	}
 
 	inline ~LOGMVE() noexcept
 	{
+		if (!pl.fLog)
+			return;
 		LogClose(bdg.SzDecodeMvPost(mvePrev), wjoin(SzFromEv(-mveBest.ev), SzEvt()), LgfEvt());
 		SetLgdShow(lgdSav);
 		imvExpand = imvExpandSav;
@@ -421,12 +640,14 @@ public:
 	LOGITD(PLAI& pl, BDG& bdg, const MVE& mveBest, AB ab, int d) noexcept : 
 			LOGSEARCH(pl, bdg), mveBest(mveBest)
 	{
-		LogOpen(L"Depth", wjoin(d, ab), lgfNormal);
+		if (pl.fLog)
+			LogOpen(L"Depth", wjoin(d, ab), lgfNormal);
 	}
 
 	~LOGITD() noexcept
 	{
-		LogClose(L"Depth", wjoin(L"[BF=" + (wstring)pl.stbfMainTotal + L"]",
+		if (pl.fLog)
+			LogClose(L"Depth", wjoin(L"[BF=" + (wstring)pl.stbfMainTotal + L"]",
 								 bdg.SzDecodeMvPost(mveBest),
 								 SzFromEv(mveBest.ev)), 
 				 lgfNormal);
@@ -443,19 +664,68 @@ public:
  */
 
 
-VMVES::VMVES(BDG& bdg, PLAI* pplai, int d, GG gg) noexcept : VMVE(), pplai(pplai), gg(gg), d(d), pmveNext(begin()), tscCur(tscPrincipalVar)
+VMVES::VMVES(BDG& bdg, PLAI* pplai, int d, GG gg) noexcept : VMVE(), pplai(pplai), gg(gg), d(d), pmveNext(begin()), tscCur(tscPrincipalVar), fRootOrder(false), fNextPicked(false), habdNext(0), cmvuQuiet(0)
 {
 	bdg.GenMoves(*this, gg == ggNoisyAndChecks ? ggAll : gg);
 	Reset(bdg);
 }
 
 
-void VMVES::Reset(BDG& bdg) noexcept
+void VMVES::Reset(BDG& bdg, int imveFirst) noexcept
 {
-	pmveNext = begin();
+	pmveNext = begin() + imveFirst;
 	cmvLegal = 0;
 	tscCur = tscPrincipalVar;
-	PrepTscCur(bdg, begin());
+	fNextPicked = false;
+	cmvuQuiet = 0;
+	if (!fRootOrder)
+		PrepTscCur(bdg, pmveNext);
+}
+
+
+/*	VMVES::SortRoot
+ *
+ *	Orders the root moves for the next iteration of iterative deepening. The best 
+ *	move from this iteration goes first, and the rest are sorted by the number of 
+ *	nodes it took to search them, which is a good measure of how hard it was to 
+ *	refute the move. Once sorted, the root moves are enumerated in this order and 
+ *	are no longer scored. The sort is stable, so ties keep their old order. The 
+ *	first imveFirst moves, which are MultiPV lines, are already in order.
+ */
+void VMVES::SortRoot(const MVE& mveBest, int imveFirst) noexcept
+{
+	auto CmveSort = [this, &mveBest](const MVE& mve) {
+		return mve == mveBest ? UINT64_MAX : pplai->CmveRoot(mve);
+	};
+
+	for (int imve = imveFirst + 1; imve < size(); imve++) {
+		MVE mve = (*this)[imve];
+		uint64_t cmve = CmveSort(mve);
+		int imveTo = imve;
+		for ( ; imveTo > imveFirst && CmveSort((*this)[imveTo - 1]) < cmve; imveTo--)
+			(*this)[imveTo] = (*this)[imveTo - 1];
+		(*this)[imveTo] = mve;
+	}
+	fRootOrder = true;
+}
+
+
+/*	VMVES::MoveMveTo
+ *
+ *	Moves mve, which must be at or after imveTo in the list, to position imveTo,
+ *	sliding the moves in between down one. 
+ */
+void VMVES::MoveMveTo(const MVE& mve, int imveTo) noexcept
+{
+	int imve = imveTo;
+	while (imve < size() && (*this)[imve] != mve)
+		imve++;
+	if (imve == size())
+		return;
+	MVE mveT = (*this)[imve];
+	for ( ; imve > imveTo; imve--)
+		(*this)[imve] = (*this)[imve - 1];
+	(*this)[imveTo] = mveT;
 }
 
 
@@ -464,6 +734,12 @@ void VMVES::Reset(BDG& bdg) noexcept
  *	Finds the next move in the move list, returning false if there is no such
  *	move. The move is returned in pmve. The move is actually made on the board
  *	and illegal moves are checked for
+ * 
+ *	Before we make the move, we also pick the move that will come after it, if
+ *	we can do that without preparing a new score type, and start loading its
+ *	transposition table entry, so the memory fetch overlaps the entire search 
+ *	of this move. When we can't, the entry of the move we're returning is 
+ *	loaded here, which only overlaps the move making and the legality test.
  */
 bool VMVES::FEnumMvNext(BDG& bdg, MVE*& pmve) noexcept
 {
@@ -471,18 +747,40 @@ bool VMVES::FEnumMvNext(BDG& bdg, MVE*& pmve) noexcept
 
 		/* swap the best move into the next mve to return */
 
-		MVE* pmveBest;
-		for (; (pmveBest = PmveBestFromTscCur(pmveNext)) == nullptr;
-			 tscCur++, PrepTscCur(bdg, pmveNext))
-			;
 		pmve = &*pmveNext;
-		swap(*pmveNext, *pmveBest);
+		HABD habdAfter;
+		if (fNextPicked)
+			habdAfter = habdNext;
+		else {
+			if (!fRootOrder) {
+				MVE* pmveBest;
+				for (; (pmveBest = PmveBestFromTscCur(pmveNext)) == nullptr;
+					 tscCur++, PrepTscCur(bdg, pmveNext))
+					;
+				swap(*pmveNext, *pmveBest);
+			}
+			habdAfter = genhabd.HabdAfterMv(bdg, *pmve);
+			pplai->xt.Prefetch(habdAfter);
+		}
 		pmveNext++;
 
+		/* pick the move after this one and prefetch its entry */
+
+		fNextPicked = false;
+		if (pmveNext < end()) {
+			MVE* pmveBest = fRootOrder ? &*pmveNext : PmveBestFromTscCur(pmveNext);
+			if (pmveBest) {
+				swap(*pmveNext, *pmveBest);
+				habdNext = genhabd.HabdAfterMv(bdg, *pmveNext);
+				pplai->xt.Prefetch(habdNext);
+				fNextPicked = true;
+			}
+		}
+
 		/* make sure move is legal */
 
 		bdg.MakeMv(*pmve);
-		pplai->xt.Prefetch(bdg);
+		assert(bdg.habd == habdAfter);
 		if (!bdg.FInCheck(~bdg.cpcToMove)) {
 			cmvLegal++;
 			if (GgType(gg) != ggNoisyAndChecks)
@@ -573,21 +871,27 @@ void VMVES::PrepTscCur(BDG& bdg, VMVE::it pmveFirst) noexcept
 	switch (tscCur) {
 	case tscPrincipalVar:
 	{
-		/* first time through the enumeration, snag the principal variation. This can
-		   be done very quickly with just a transposition table probe. While we're at
+		/* first time through the enumeration, snag the principal variation. If we're
+		   still following the PV from the last iteration, that move goes first, and
+		   the transposition table probably has another good move, either from an 
+		   exact eval or one that caused a cut-off. While we're at
 		   it, go ahead and reset all the other moves to nil so we re-score them on
 		   subsequent passes */
-		XEV* pxev = pplai->xt.Find(bdg, d, d);
+		MV mvPVFollow = pplai->MvPvFollow(bdg, d);
+		XEV xev;
 		MVE mvePV;
-		if (pxev && pxev->tev() == tevEqual) {
-			mvePV = bdg.MveFromMv(pxev->mv());
-			mvePV.ev = -pxev->ev(d);
+		if (pplai->xt.FFind(bdg, d, d, xev) && xev.tev() != tevLower) {
+			mvePV = bdg.MveFromMv(xev.mv());
+			mvePV.ev = -xev.ev(d);
 		}
 		for (VMVE::it pmve = pmveFirst; pmve < end(); pmve++) {
 			assert(!pmve->fIsNil());
 			pmve->SetTsc(tscNil);
-			if (mvePV == *pmve) {
-				assert(pxev != nullptr);
+			if (!mvPVFollow.fIsNil() && *pmve == mvPVFollow) {
+				pmve->SetTsc(tscPrincipalVar);
+				pmve->ev = evInf;
+			}
+			else if (mvePV == *pmve) {
 				pmve->SetTsc(tscPrincipalVar);
 				pmve->ev = mvePV.ev;
 			}
@@ -614,7 +918,7 @@ void VMVES::PrepTscCur(BDG& bdg, VMVE::it pmveFirst) noexcept
 		for (VMVE::it pmve = pmveFirst; pmve < end(); pmve++) {
 			if (pmve->tsc() != tscNil)
 				continue;
-			if (pplai->FScoreKiller(bdg, *pmve))
+			if (pplai->FScoreKiller(bdg, *pmve, d) || pplai->FScoreCounter(bdg, *pmve))
 				pmve->SetTsc(tscKiller);
 			else if (pplai->FScoreHistory(bdg, *pmve))
 				pmve->SetTsc(tscHistory);
@@ -627,21 +931,18 @@ void VMVES::PrepTscCur(BDG& bdg, VMVE::it pmveFirst) noexcept
 
 	case tscXTable:
 	{
-#ifdef LATER
-		/* this actually makes it worse */
-		/* get the eval of any move that has an entry in the tranposition table */
+		/* get the eval of any move that has an entry in the tranposition table;
+		   we can compute the hash of the resulting board without making the
+		   move, so this is just a probe per move */
 		for (VMVE::it pmve = pmveFirst; pmve < end(); pmve++) {
 			if (pmve->tsc() != tscNil)
 				continue;
-			bdg.MakeMvSq(*pmve);
-			XEV* pxev = pplai->xt.Find(bdg, d, d);
-			if (pxev && pxev->tev() == tevEqual) {
+			XEV xev;
+			if (pplai->xt.FFind(genhabd.HabdAfterMv(bdg, *pmve), d + 1, d + 1, xev) && xev.tev() == tevEqual) {
 				pmve->SetTsc(tscXTable);
-				pmve->ev = -pxev->ev(d);
+				pmve->ev = -xev.ev(d + 1);
 			}
-			bdg.UndoMvSq(*pmve);
 		}
-#endif
 		break;
 	}
 
@@ -672,26 +973,173 @@ void VMVES::PrepTscCur(BDG& bdg, VMVE::it pmveFirst) noexcept
  *	Returns information in spmv for how the board should be display the move,
  *	but this isn't used in AI players. 
  * 
- *	For an AI, this is the root node of the alpha-beta search.
+ *	The search itself runs on its own thread, while the calling thread keeps
+ *	the UI alive until the search is done. The UI thread cancels the search by
+ *	setting sint, and the search checks the clock itself every so many nodes.
  */
 MVE PLAI::MveGetNext(SPMV& spmv) noexcept
 {
 	spmv = spmvAnimate;
-	cYield = 0; sint = sintNull;
+	sint = sintNull;
+	fBestOverall = false;
+	dmsecPonder = 0;
+
+	MVE mve;
+	thread thdSearch([this, &mve]() { mve = MveSearch(); });
+	WaitSearch(thdSearch);
+	thdSearch.join();
+	return mve;
+}
+
+
+/*	PLAI::MveAnalyze
+ *
+ *	Searches the game position right on the calling thread, without touching
+ *	the UI, and returns the best move along with its principal variation. This
+ *	is for batch analysis, where many AIs are searching at once, so it's
+ *	usually run with logging turned off.
+ */
+MVE PLAI::MveAnalyze(vector<MV>& vmvPV) noexcept
+{
+	sint = sintNull;
+	fBestOverall = false;
+	dmsecPonder = 0;
+
+	MVE mve = MveSearch();
+	vmvPV.assign(amvPVRoot, amvPVRoot + cmvPVRoot);
+	return mve;
+}
+
+
+/*	PLAI::WaitSearch
+ *
+ *	Keeps the UI running on the calling thread while the search thread does its 
+ *	work. If the user hits Esc, we tell the search to cancel. UI drawing is 
+ *	serialized with logging from the search thread through the app's UI lock.
+ */
+void PLAI::WaitSearch(thread& thdSearch) noexcept
+{
+	HANDLE hthd = thdSearch.native_handle();
+	while (::MsgWaitForMultipleObjects(1, &hthd, FALSE, INFINITE, QS_ALLINPUT) == WAIT_OBJECT_0 + 1) {
+		try {
+			lock_guard<recursive_mutex> lock(papp->mtxUI);
+			ga.puiga->PumpMsg();
+		}
+		catch (...) {
+			{
+				lock_guard<mutex> lock(mtxSearch);
+				sint = sintCanceled;
+			}
+			cvSearch.notify_all();
+		}
+	}
+}
+
+
+/*	PLAI::WaitPonder
+ *
+ *	If the search finishes while we're pondering, we still can't move until the 
+ *	opponent does, so we wait on the search thread for the ponder hit or the 
+ *	stop.
+ */
+void PLAI::WaitPonder(void) noexcept
+{
+	unique_lock<mutex> lock(mtxSearch);
+	cvSearch.wait(lock, [this] { return !fPonder || sint != sintNull; });
+}
+
+
+/*	PLAI::SetPonder
+ *
+ *	Makes the next search a ponder search, which searches on the opponent's
+ *	time, usually on the position after the reply we expect. A ponder search 
+ *	has no time management and doesn't return until PonderHit or StopSearch
+ *	is called.
+ */
+void PLAI::SetPonder(bool fPonder) noexcept
+{
+	this->fPonder = fPonder;
+}
+
+
+/*	PLAI::PonderHit
+ *
+ *	The opponent played the move we were pondering on, so the ponder search
+ *	becomes the real search. It keeps going under the normal time management, 
+ *	with our clock starting now. Called from the UI thread.
+ */
+void PLAI::PonderHit(void) noexcept
+{
+	if (!fPonder)
+		return;
+	dmsecPonder = DmsecMoveSoFar();
+	{
+		lock_guard<mutex> lock(mtxSearch);
+		fPonder = false;
+	}
+	cvSearch.notify_all();
+}
+
+
+/*	PLAI::StopSearch
+ *
+ *	Stops the search as soon as possible. If we have a best move, the search 
+ *	returns it, otherwise the search is canceled. This is also how a ponder 
+ *	miss is handled; whatever the ponder search put in the transposition table
+ *	stays there for the real search. Called from the UI thread.
+ */
+void PLAI::StopSearch(void) noexcept
+{
+	{
+		lock_guard<mutex> lock(mtxSearch);
+		fPonder = false;
+		sint = fBestOverall ? sintTimedOut : sintCanceled;
+	}
+	cvSearch.notify_all();
+}
+
+
+/*	PLAI::MvPonder
+ *
+ *	The move we expect the opponent to reply with, which is the second move of 
+ *	the principal variation of the last search. 
+ */
+MV PLAI::MvPonder(void) const noexcept
+{
+	return cmvPVRoot >= 2 ? amvPVRoot[1] : mvNil;
+}
+
+
+/*	PLAI::MveSearch
+ *
+ *	The root of the alpha-beta search, which runs on the search thread. Returns
+ *	the best move we found.
+ */
+MVE PLAI::MveSearch(void) noexcept
+{
 	StartMoveLog();
 
 	BDG bdg = ga.bdg;
 	habdRand = genhabd.HabdRandom(rgen);
+	if (fecoRandom)
+		evc.Clear();	/* random evals change with every search */
 	InitBreak();
 	xt.Clear();		
 	xt.BumpAge();
 	AgeHistory();
 
 	mveBestOverall = MVE(mvuNil, -evInf);
+	imveRoot = bdg.imveCurLast;
+	cmvPVRoot = 0;
+	cpvMultiCur = 0;
 	VMVES vmves(bdg, this, 0, ggLegal);
+	bool fInCheck = bdg.FInCheck(bdg.cpcToMove);
+	InitSs(fInCheck);
+	stbfMain.Init();
 
 	InitWeightTables();
 	InitTimeMan(bdg);
+	StartHelpers(bdg);
 
 	/* main iterative deepening and aspiration window loop */
 
@@ -703,26 +1151,203 @@ MVE PLAI::MveGetNext(SPMV& spmv) noexcept
 		mveBest = MVE(mvuNil, -evInf);
 
 		/* stats and logging */
+		stbfMainPrev = stbfMain;
 		stbfMain.Init(); stbfMainAndQ.Init();
 		LOGITD logitd(*this, bdg, mveBest, ab, dLim);
 		stbfMain.IncGen(); stbfMainAndQ.IncGen();
 
-		/* do search for each move at current depth/aspiration window */
+		/* do search for each move at current depth/aspiration window, then order 
+		   the root moves for the next pass */
+		acmvPV[0] = 0;
+		InitRootNodes();
 		vmves.Reset(bdg);
-		FSearchMveBest(bdg, vmves, mveBest, ab, 0, dLim, tsAll);
-		SaveXt(bdg, mveBest, ab, 0, dLim);
+		FSearchMveBest(bdg, vmves, mveBest, ab, 0, dLim, fInCheck, evInf, tsAll);
+		SaveXt(bdg, mveBest, ab, 0, dLim, evInf);
+		int cpvSort = 0;
+		if (cpvMulti > 1 && sint == sintNull && !ab.FEvIsBelow(mveBest.ev) && !ab.FEvIsAbove(mveBest.ev))
+			cpvSort = CpvSearchMulti(bdg, vmves, mveBest, dLim, fInCheck);
+		vmves.SortRoot(mveBest, cpvSort);
 		
 		stbfMainTotal += stbfMain; stbfMainAndQTotal += stbfMainAndQ;
 	} while (!vmves.FOnlyOneMove(mveBestOverall) && 
 			 FDeepen(bdg, mveBest, ab, dLim) && 
 			 FBeforeDeadline(dLim));
 
+	WaitPonder();
+	if (sint == sintNull)
+		dmsecStop = DmsecMoveSoFar();
+#ifndef NOSTATS
+	xts += xt.xtsThread;
+#endif
+	StopHelpers();
+	MeasureLatency();
 	EndMoveLog();
 	LogBestMove(ga.bdg, mveBestOverall, dLim, dSel);
 	return mveBestOverall;
 }
 
 
+/*	PLAI::StartHelpers
+ *
+ *	Starts up the helper search threads for the Lazy SMP multithreaded search.
+ *	Each helper gets its own copy of the board, and its own killers and history, 
+ *	and does its own iterative deepening search on the root position, sharing
+ *	what it finds with the rest of the threads through the transposition table. 
+ *	Helpers skip depths in a pattern that depends on the thread (see 
+ *	FSkipDepthHelper), so they don't all search the same tree in lock step.
+ * 
+ *	Helpers are created with PplaiHelperNew, so they're the same kind of AI as 
+ *	we are. The eval weights can be changed after the AI is created, so we 
+ *	still copy them over at the start of every search.
+ */
+void PLAI::StartHelpers(const BDG& bdg)
+{
+	/* a node budget is only reproducible if one thread does all the work */
+	if (ttm == ttmConstNodes)
+		return;
+
+	while ((int)vpplaiHelper.size() < cthd - 1)
+		vpplaiHelper.push_back(PplaiHelperNew());
+
+	for (int ithd = 1; ithd < cthd; ithd++) {
+		PLAI* pplai = vpplaiHelper[ithd - 1];
+		pplai->fecoPsqt = fecoPsqt;
+		pplai->fecoMaterial = fecoMaterial;
+		pplai->fecoMobility = fecoMobility;
+		pplai->fecoKingSafety = fecoKingSafety;
+		pplai->fecoPawnStructure = fecoPawnStructure;
+		pplai->fecoTempo = fecoTempo;
+		pplai->fecoRandom = fecoRandom;
+		memcpy(pplai->mpapcsqevOpening, mpapcsqevOpening, sizeof(mpapcsqevOpening));
+		memcpy(pplai->mpapcsqevMiddleGame, mpapcsqevMiddleGame, sizeof(mpapcsqevMiddleGame));
+		memcpy(pplai->mpapcsqevEndGame, mpapcsqevEndGame, sizeof(mpapcsqevEndGame));
+		pplai->habdRand = habdRand;
+		pplai->devProbCut = devProbCut;
+		if (fecoRandom)
+			pplai->evc.Clear();
+		pplai->AgeHistory();
+		pplai->sint = sintNull;
+		vthdHelper.emplace_back(&PLAI::SearchHelper, pplai, bdg, ithd);
+	}
+}
+
+
+/*	PLAI::PplaiHelperNew
+ *
+ *	Creates a helper search thread AI that evaluates the same way we do.
+ */
+PLAI* PLAI::PplaiHelperNew(void)
+{
+	return new PLAI(*this);
+}
+
+
+/*	PLAI::FSkipDepthHelper
+ *
+ *	Returns true if helper thread ithd should skip the iteration at depth dLim.
+ *	Each helper skips runs of depths, with the run length and where the runs
+ *	start depending on the thread, so with lots of threads, every depth gets 
+ *	searched by some of them while they spread out over different depths.
+ */
+bool PLAI::FSkipDepthHelper(int ithd, int dLim) const noexcept
+{
+	static const int mpithddSkipSize[] = { 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4 };
+	static const int mpithddSkipPhase[] = { 0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7 };
+	static_assert(size(mpithddSkipSize) == size(mpithddSkipPhase));
+
+	int i = (ithd - 1) % (int)size(mpithddSkipSize);
+	return ((dLim + mpithddSkipPhase[i]) / mpithddSkipSize[i]) % 2 != 0;
+}
+
+
+/*	PLAI::StopHelpers
+ *
+ *	Stops all the helper search threads and waits for them to finish. Adds the
+ *	helper's node counts into our stats.
+ */
+void PLAI::StopHelpers(void)
+{
+	if (vthdHelper.empty())
+		return;
+	for (PLAI* pplai : vpplaiHelper)
+		pplai->sint = sintCanceled;
+	for (thread& thd : vthdHelper)
+		thd.join();
+	vthdHelper.clear();
+	for (PLAI* pplai : vpplaiHelper)
+		cmveMove += pplai->cmveMove;
+#ifndef NOSTATS
+	for (PLAI* pplai : vpplaiHelper) {
+		stbfMainAndQTotal += pplai->stbfMainAndQTotal;
+		xts += pplai->xts;
+		pplai->xts.Clear();
+	}
+#endif
+}
+
+
+/*	PLAI::SearchHelper
+ *
+ *	The iterative deepening loop for helper search threads. Very similar to 
+ *	the main loop in MveGetNext, but we don't do any logging or time management, 
+ *	and we keep searching until the main thread tells us to stop. ithd is the
+ *	helper's thread number, which determines which depths it skips.
+ */
+void PLAI::SearchHelper(BDG bdg, int ithd) noexcept
+{
+	stbfMainTotal.Init(); stbfMainAndQTotal.Init();
+	cmveMove = 0;
+#ifndef NOSTATS
+	cmvLmr = cmvLmrResearch = 0;
+	cmvPruneMoveCount = cmvPruneFutility = 0;
+	cmvCut = cmvCutFirst = 0;
+	cbdIir = cbdProbCut = 0;
+	cbdNullVerify = cbdNullVerifyFail = 0;
+	xt.ClearStats();
+#endif
+	imveRoot = bdg.imveCurLast;
+	cmvPVRoot = 0;
+	dSel = 0;
+
+	VMVES vmves(bdg, this, 0, ggLegal);
+	bool fInCheck = bdg.FInCheck(bdg.cpcToMove);
+	InitSs(fInCheck);
+	AB ab(-evInf, evInf);
+	int dLim = 2;
+	while (FSkipDepthHelper(ithd, dLim))
+		dLim++;
+	while (sint == sintNull && dLim < dMax / 2) {
+		MVE mveBest = MVE(mvuNil, -evInf);
+		stbfMain.Init(); stbfMainAndQ.Init();
+		stbfMain.IncGen(); stbfMainAndQ.IncGen();
+		acmvPV[0] = 0;
+		InitRootNodes();
+		vmves.Reset(bdg);
+		FSearchMveBest(bdg, vmves, mveBest, ab, 0, dLim, fInCheck, evInf, tsAll);
+		stbfMainTotal += stbfMain; stbfMainAndQTotal += stbfMainAndQ;
+		if (sint != sintNull || vmves.cmvLegal == 0)
+			break;
+		SaveXt(bdg, mveBest, ab, 0, dLim, evInf);
+		vmves.SortRoot(mveBest);
+		if (ab.FEvIsBelow(mveBest.ev))
+			ab.AdjMissLow();
+		else if (ab.FEvIsAbove(mveBest.ev))
+			ab.AdjMissHigh();
+		else {
+			if (FEvIsMate(mveBest.ev) || FEvIsMate(-mveBest.ev))
+				break;
+			ab = ab.AbAspiration(mveBest.ev, 20);
+			do
+				dLim++;
+			while (FSkipDepthHelper(ithd, dLim));
+		}
+	}
+#ifndef NOSTATS
+	xts += xt.xtsThread;
+#endif
+}
+
+
 /*	PLAI::FSearchMveBest
  *
  *	Finds the best move for the given board and sorted movelist, using the given
@@ -730,35 +1355,226 @@ MVE PLAI::MveGetNext(SPMV& spmv) noexcept
  *
  *	Handles the principal value search optimization.
  */
-bool PLAI::FSearchMveBest(BDG& bdg, VMVES& vmves, MVE& mveBest, AB ab, int d, int& dLim, TS ts) noexcept
+bool PLAI::FSearchMveBest(BDG& bdg, VMVES& vmves, MVE& mveBest, AB ab, int d, int& dLim, 
+						  bool fInCheck, EV evStatic, TS ts) noexcept
 {
 	/* do first move (probably a PV move) with full a-b window */
 
 	MVE* pmve;
 	if (!vmves.FEnumMvNext(bdg, pmve))
 		return false;
+	uint64_t cmveBefore = CmveMoveSoFar();
 	pmve->ev = -EvBdgSearch(bdg, *pmve, -ab, d + 1, dLim, ts);
 	vmves.UndoMv(bdg);
-	if (FPrune(bdg, *pmve, mveBest, ab, d, dLim))
+	vmves.SaveSearched(*pmve);
+	if (d == 0)
+		CmveRoot(*pmve) += CmveMoveSoFar() - cmveBefore;
+	if (FPrune(bdg, *pmve, mveBest, ab, d, dLim)) {
+		SaveCutoff(bdg, vmves, *pmve, d, dLim);
 		return true;
+	}
 
 	/* subsequent moves get the PV pre-search optimization which uses an
 	   ultra-narrow window. We pray that narrow window quickly fails low;
-	   if we don't, redo the search with the full window */
+	   if we don't, redo the search with the full window. Late quiet moves
+	   get their pre-search at a reduced depth, and if that doesn't fail low,
+	   we re-search them at full depth before trying the full window */
 
 	while (vmves.FEnumMvNext(bdg, pmve)) {
-		pmve->ev = -EvBdgSearch(bdg, *pmve, -ab.AbNull(), d + 1, dLim, 
-								ts+tsNoPruneNullMove+tsNoPruneFutility+tsNoPruneRazoring);
+		if (FPruneLateMove(bdg, *pmve, vmves.cmvLegal, mveBest, evStatic, ab, d, dLim, fInCheck, ts)) {
+			vmves.UndoMv(bdg);
+			continue;
+		}
+		cmveBefore = CmveMoveSoFar();
+		TS tsPre = ts+tsNoPruneNullMove+tsNoPruneFutility+tsNoPruneRazoring;
+		int dReduce = DReduceLmr(bdg, *pmve, vmves.cmvLegal, d, dLim, fInCheck, ts);
+		pmve->ev = -EvBdgSearch(bdg, *pmve, -ab.AbNull(), d + 1, dLim - dReduce, tsPre);
+		if (dReduce > 0 && !ab.FEvIsBelow(pmve->ev)) {
+#ifndef NOSTATS
+			cmvLmrResearch++;
+#endif
+			pmve->ev = -EvBdgSearch(bdg, *pmve, -ab.AbNull(), d + 1, dLim, tsPre);
+		}
  		if (!ab.FEvIsBelow(pmve->ev) && !ab.fIsNull())
 			pmve->ev = -EvBdgSearch(bdg, *pmve, -ab, d + 1, dLim, ts);
 		vmves.UndoMv(bdg);
-		if (FPrune(bdg, *pmve, mveBest, ab, d, dLim))
+		vmves.SaveSearched(*pmve);
+		if (d == 0)
+			CmveRoot(*pmve) += CmveMoveSoFar() - cmveBefore;
+		if (FPrune(bdg, *pmve, mveBest, ab, d, dLim)) {
+			SaveCutoff(bdg, vmves, *pmve, d, dLim);
 			return true;
+		}
 	}
 	return false;
 }
 
 
+/*	PLAI::FPruneLateMove
+ *
+ *	Per-move pruning near the horizon. The move mve has already been made on the
+ *	board, and cmv is the number of legal moves we've tried at this node, 
+ *	including this one. Quiet moves are skipped entirely once we've tried enough 
+ *	moves for the remaining depth (move count pruning), or when the static eval
+ *	plus a margin can't possibly reach alpha (futility pruning). evStatic is evInf
+ *	at the root and when we're in check, which turns this off.
+ */
+bool PLAI::FPruneLateMove(BDG& bdg, const MVE& mve, int cmv, const MVE& mveBest, EV evStatic, 
+						  AB ab, int d, int dLim, bool fInCheck, TS ts) noexcept
+{
+	const int ddPrune = 5;
+	static const int mpddcmvPrune[ddPrune] = { 0, 5, 8, 13, 20 };
+
+	if ((ts & tsNoPruneLateMove) || fInCheck || evStatic == evInf || d == 0)
+		return false;
+	int dd = dLim - d;
+	if (dd >= ddPrune || FEvIsMate(-mveBest.ev))
+		return false;
+	if (mve.fIsCapture() || mve.apcPromote() != apcNull || mve.tsc() <= tscKiller)
+		return false;
+
+	bool fPruneMoveCount = cmv > mpddcmvPrune[dd];
+	bool fPruneFutility = evStatic + mpdddevFutility[dd] <= ab.evAlpha;
+	if (!fPruneMoveCount && !fPruneFutility)
+		return false;
+	if (bdg.FInCheck(bdg.cpcToMove))
+		return false;
+
+#ifndef NOSTATS
+	if (fPruneMoveCount)
+		cmvPruneMoveCount++;
+	else
+		cmvPruneFutility++;
+#endif
+	return true;
+}
+
+
+/*	PLAI::FReduceIir
+ *
+ *	Internal iterative reduction. Deep nodes with no principal variation or 
+ *	transposition table move to try first get bad move ordering, so we reduce the
+ *	search depth by a ply. Next time we get here, we'll have a move from the 
+ *	transposition table.
+ * 
+ *	Exact and fail-high entries count as having a move, because their move is
+ *	the best move or the refutation, and move ordering tries it first; fail-low
+ *	entries don't, because their move isn't trustworthy.
+ */
+bool PLAI::FReduceIir(BDG& bdg, int d, int dLim, TS ts) noexcept
+{
+	const int ddIirMin = 4;
+
+	if ((ts & tsNoReduceIIR) || dLim - d < ddIirMin)
+		return false;
+	if (!MvPvFollow(bdg, d).fIsNil())
+		return false;
+	XEV xev;
+	if (xt.FFind(bdg, d, d, xev) && xev.tev() != tevLower)
+		return false;
+#ifndef NOSTATS
+	cbdIir++;
+#endif
+	return true;
+}
+
+
+/*	PLAI::DReduceLmr
+ *
+ *	Late move reductions. Returns the number of plies to reduce the search of
+ *	the move mve, which has already been made on the board. cmv is the number of
+ *	legal moves we've tried at this node, including this one. Only quiet moves 
+ *	late in the move ordering get reduced; captures, promotions, killers, and 
+ *	checks, in or out, are always searched at full depth. Nodes where our position
+ *	isn't improving get reduced an extra ply.
+ */
+int PLAI::DReduceLmr(BDG& bdg, const MVE& mve, int cmv, int d, int dLim, bool fInCheck, TS ts) noexcept
+{
+	const int cmvFullDepth = 3;	/* moves we always search at full depth */
+	const int dReduceMin = 3;	/* don't reduce near the leaves */
+
+	if (ts & tsNoReduceLMR)
+		return 0;
+	if (cmv <= cmvFullDepth || dLim - d < dReduceMin || fInCheck)
+		return 0;
+	if (mve.fIsCapture() || mve.apcPromote() != apcNull || mve.tsc() <= tscKiller)
+		return 0;
+	if (bdg.FInCheck(bdg.cpcToMove))
+		return 0;
+
+	int dReduce = lmr.DReduce(dLim - d, cmv) + !ass[d].fImproving;
+	dReduce = min(dReduce, dLim - d - 1);
+#ifndef NOSTATS
+	cmvLmr += dReduce > 0;
+#endif
+	return dReduce;
+}
+
+
+/*	PLAI::CpvSearchMulti
+ *
+ *	MultiPV search. Once the root search at depth dLim has found its best move,
+ *	mveBest, we search for the next best lines. Each line is a full root search 
+ *	that skips the moves of the lines we've already found, which we keep at the 
+ *	front of the root move list. Each line has its own aspiration window around
+ *	its score from the last iteration. Everything shares the transposition 
+ *	table, so the extra lines are a lot cheaper than the first.
+ * 
+ *	Returns the number of lines we found. The lines are only saved in amveMulti
+ *	and amvPVMulti if we find all of them, so an interrupt leaves the lines of
+ *	the last completed iteration in place. The first line's PV is put back in
+ *	amvPV[0] when we're done, so it's the PV the caller saves for the root.
+ */
+int PLAI::CpvSearchMulti(BDG& bdg, VMVES& vmves, const MVE& mveBest, int dLim, bool fInCheck) noexcept
+{
+	vmves.MoveMveTo(mveBest, 0);
+	amveMultiNext[0] = mveBest;
+	acmvPVMultiNext[0] = acmvPV[0];
+	memcpy(amvPVMultiNext[0], amvPV[0], acmvPV[0] * sizeof(MV));
+
+	int cpvPrev = cpvMultiCur;
+	int cpv = min(cpvMulti, vmves.size());
+	int ipv;
+	for (ipv = 1; ipv < cpv; ipv++) {
+		AB ab(-evInf, evInf);
+		if (ipv < cpvPrev)
+			ab = ab.AbAspiration(amveMulti[ipv].ev, 20);
+		MVE mveLine;
+		while (true) {
+			mveLine = MVE(mvuNil, -evInf);
+			acmvPV[0] = 0;
+			vmves.Reset(bdg, ipv);
+			int dLimLine = dLim;
+			FSearchMveBest(bdg, vmves, mveLine, ab, 0, dLimLine, fInCheck, evInf, tsAll);
+			if (sint.load(memory_order_relaxed) != sintNull)
+				goto Done;
+			if (ab.FEvIsBelow(mveLine.ev))
+				ab.AdjMissLow();
+			else if (ab.FEvIsAbove(mveLine.ev))
+				ab.AdjMissHigh();
+			else
+				break;
+		}
+		vmves.MoveMveTo(mveLine, ipv);
+		amveMultiNext[ipv] = mveLine;
+		acmvPVMultiNext[ipv] = acmvPV[0];
+		memcpy(amvPVMultiNext[ipv], amvPV[0], acmvPV[0] * sizeof(MV));
+	}
+
+	cpvMultiCur = cpv;
+	dPvMulti = dLim;
+	memcpy(amveMulti, amveMultiNext, cpv * sizeof(MVE));
+	memcpy(acmvPVMulti, acmvPVMultiNext, cpv * sizeof(int));
+	for (int ipvT = 0; ipvT < cpv; ipvT++)
+		memcpy(amvPVMulti[ipvT], amvPVMultiNext[ipvT], acmvPVMultiNext[ipvT] * sizeof(MV));
+
+Done:
+	acmvPV[0] = acmvPVMultiNext[0];
+	memcpy(amvPV[0], amvPVMultiNext[0], acmvPV[0] * sizeof(MV));
+	return ipv;
+}
+
+
 /*	PLAI::EvBdgSearch
  *
  *	Evaluates the board/move from the point of view of the person who has the move,
@@ -773,6 +1589,7 @@ bool PLAI::FSearchMveBest(BDG& bdg, VMVES& vmves, MVE& mveBest, AB ab, int d, in
  */
 EV PLAI::EvBdgSearch(BDG& bdg, const MVE& mvePrev, AB abInit, int d, int dLim, TS ts) noexcept
 {
+	acmvPV[d] = 0;
 	stbfMain.IncNode();
 
 	/* if we're at depth, go to quiescence to get static eval */
@@ -781,6 +1598,7 @@ EV PLAI::EvBdgSearch(BDG& bdg, const MVE& mvePrev, AB abInit, int d, int dLim, T
 		return EvBdgQuiescent(bdg, mvePrev, abInit, d, ts);
 	
 	stbfMainAndQ.IncNode();
+	CheckInterrupt();
 	MVE mveBest;
 	LOGMVE logmve(*this, bdg, mvePrev, mveBest, abInit, d, ' ');
 
@@ -793,17 +1611,25 @@ EV PLAI::EvBdgSearch(BDG& bdg, const MVE& mvePrev, AB abInit, int d, int dLim, T
 	/* check transposition table, evaluate the board, then try futility pruning and
 	   null move heuristic pruning tricks */
 
+	SS& ss = ass[d];
+	ss.evStatic = evInf;
 	if (FLookupXt(bdg, mveBest, abInit, d, dLim))
 		return mveBest.ev;
-	bool fInCheck = bdg.FInCheck(bdg.cpcToMove);
+	bool fInCheck = ss.fInCheck = bdg.FInCheck(bdg.cpcToMove);
 	GG gg = ggAll + ggPseudo;
-	if (fInCheck)
+	EV evStatic = evInf;
+	if (fInCheck) {
+		ss.fImproving = false;
 		dLim++;
+	}
 	else {
-		EV evStatic = EvBdgStatic(bdg, mvePrev);
+		evStatic = ss.evStatic = EvBdgStaticXt(bdg, mvePrev);
+		ss.fImproving = FImproving(d);
 		if (FTryStaticNullMove(bdg, mveBest, evStatic, abInit, d, dLim, ts))
 			return mveBest.ev;
-		if (FTryNullMove(bdg, mveBest, abInit, d, dLim, ts))
+		if (FTryNullMove(bdg, mveBest, evStatic, abInit, d, dLim, ts))
+			return mveBest.ev;
+		if (FTryProbCut(bdg, mveBest, abInit, d, dLim, ts))
 			return mveBest.ev;
 		if (FTryRazoring(bdg, mveBest, evStatic, abInit, d, dLim, ts))
 			return mveBest.ev;
@@ -811,13 +1637,17 @@ EV PLAI::EvBdgSearch(BDG& bdg, const MVE& mvePrev, AB abInit, int d, int dLim, T
 			gg = ggNoisyAndChecks + ggPseudo;
 	}
 
-	/* if none of those optimizations work, generate moves and do a full search */
+	/* if none of those optimizations work, generate moves and do a full search; if
+	   we have no idea what the best move is, it's probably not worth a full depth
+	   search */
 
+	if (FReduceIir(bdg, d, dLim, ts))
+		dLim--;
 	mveBest.ev = -evInf;
 	VMVES vmves(bdg, this, d, gg);
-	if (!FSearchMveBest(bdg, vmves, mveBest, abInit, d, dLim, ts) && vmves.cmvLegal == 0)
+	if (!FSearchMveBest(bdg, vmves, mveBest, abInit, d, dLim, fInCheck, evStatic, ts) && vmves.cmvLegal == 0)
 		mveBest = MVE(mvuNil, fInCheck ? -EvMate(d) : evDraw);
-	SaveXt(bdg, mveBest, abInit, d, dLim);
+	SaveXt(bdg, mveBest, abInit, d, dLim, evStatic);
 	return mveBest.ev;
 }
 
@@ -827,10 +1657,19 @@ EV PLAI::EvBdgSearch(BDG& bdg, const MVE& mvePrev, AB abInit, int d, int dLim, T
  *	Returns the "quiet" evaluation after the given board/last move from the point 
  *	of view of the player next to move; it only considers captures and other "noisy" 
  *	moves. Alpha-beta prunes within the abInit window.
+ * 
+ *	If we're in check, we can't stand pat, so we search every evasion instead.
+ *	Otherwise captures that lose material, or that can't possibly bring us back 
+ *	up to alpha, aren't worth searching.
  */
 EV PLAI::EvBdgQuiescent(BDG& bdg, const MVE& mvePrev, AB abInit, int d, TS ts) noexcept
 {
+	const EV devDelta = 200;	/* delta pruning safety margin */
+	static const EV mpapcevDelta[apcMax] = { 0, 100, 300, 300, 500, 900, 0 };
+
+	acmvPV[d] = 0;
 	stbfMainAndQ.IncNode();
+	CheckInterrupt();
 	dSel = max(dSel, d);
 
 	int dLim = dMax;
@@ -839,106 +1678,289 @@ EV PLAI::EvBdgQuiescent(BDG& bdg, const MVE& mvePrev, AB abInit, int d, TS ts) n
 
 	if (FLookupXt(bdg, mveBest, abInit, d, d))
 		return mveBest.ev;
+	if (d >= dMax - 1)
+		return EvBdgStaticXt(bdg, mvePrev);
 
 	/* first off, the player may refuse the capture, so get full, slow static eval 
-	   and check if we're already in a pruning situation */
+	   and check if we're already in a pruning situation; when we're in check, there
+	   is no refusing */
 
 	AB ab = abInit;
-	mveBest = MVE(mvuNil, EvBdgStatic(bdg, mvePrev), tscEvOther);
-	{ LOGMVE logmve(*this, bdg, mveBest, mveBest, abInit, d, 'S'); }
-	if (FPrune(bdg, mveBest, mveBest, ab, d, dLim))
-		return mveBest.ev;
+	bool fInCheck = bdg.FInCheck(bdg.cpcToMove);
+	EV evStandPat = -evInf;
+	if (fInCheck)
+		mveBest = MVE(mvuNil, -evInf);
+	else {
+		evStandPat = EvBdgStaticXt(bdg, mvePrev);
+		mveBest = MVE(mvuNil, evStandPat, tscEvOther);
+		{ LOGMVE logmve(*this, bdg, mveBest, mveBest, abInit, d, 'S'); }
+		if (FPrune(bdg, mveBest, mveBest, ab, d, dLim, true))
+			return mveBest.ev;
+	}
 
-	/* then recursively evaluate noisy moves */
+	/* then recursively evaluate noisy moves, or every move if we're in check */
 		
-	VMVES vmves(bdg, this, d, ggPseudo + ggNoisy);
+	VMVES vmves(bdg, this, d, ggPseudo + (fInCheck ? ggAll : ggNoisy));
 	stbfMainAndQ.IncGen();
 	for (MVE* pmve = nullptr; vmves.FEnumMvNext(bdg, pmve); ) {
+		if (!fInCheck && !pmve->apcPromote() &&
+				(FLosingCapture(*pmve) ||
+				 evStandPat + mpapcevDelta[pmve->apcCapture()] + devDelta <= ab.evAlpha)) {
+			vmves.UndoMv(bdg);
+			continue;
+		}
 		pmve->ev = -EvBdgQuiescent(bdg, *pmve, -ab, d + 1, ts);
 		vmves.UndoMv(bdg);
-		if (FPrune(bdg, *pmve, mveBest, ab, d, dLim))
+		if (FPrune(bdg, *pmve, mveBest, ab, d, dLim, true))
 			break;
 	}
 
-	return mveBest.ev;
+	if (fInCheck && vmves.cmvLegal == 0)
+		mveBest = MVE(mvuNil, -EvMate(d));
+	return mveBest.ev;
+}
+
+
+/*	PLAI::FLookupXt
+ *
+ *	Checks the transposition table for a board entry at the given search depth. Returns 
+ *	true if we should stop the search at this point, either because we found an exact 
+ *	match of the board/depth, or the inexact match is outside the alpha/beta interval.
+ *
+ *	mveBest will contain the evaluation we should use if we stop the search.
+ */
+bool PLAI::FLookupXt(BDG& bdg, MVE& mveBest, AB ab, int d, int dLim) noexcept
+{
+	/* look for the entry in the transposition table */
+
+	XEV xev;
+	if (!xt.FFind(bdg, d, dLim, xev))
+		return false;
+	
+	/* adjust the value based on alpha-beta interval */
+
+	switch (xev.tev()) {
+	case tevEqual:
+		mveBest.ev = xev.ev(d);
+		break;
+	case tevHigher:
+		if (!ab.FEvIsAbove(xev.ev(d)))
+			return false;
+		mveBest.ev = ab.evBeta;
+		break;
+	case tevLower:
+		if (!ab.FEvIsBelow(xev.ev(d)))
+			return false;
+		mveBest.ev = ab.evAlpha;
+		break;
+	}
+	
+	mveBest.SetMvu(bdg.MveFromMv(xev.mv()));
+	return true;
+}
+
+
+/*	PLAI::SaveXt
+ *
+ *	Saves the evaluated board in the transposition table, including the depth,
+ *	best move, and making sure we keep track of whether the eval was outside
+ *	the a-b window. evStatic is the static eval of the board, or evInf if we 
+ *	never computed it.
+ */
+void PLAI::SaveXt(BDG& bdg, MVE mveBest, AB ab, int d, int dLim, EV evStatic) noexcept
+{
+	/* don't save cancels or timeouts */
+	if (FEvIsInterrupt(mveBest.ev))
+		return;
+
+	if (ab.FEvIsBelow(mveBest.ev))
+		xt.Save(bdg, mveBest, tevLower, d, dLim, evStatic);
+	else if (ab.FEvIsAbove(mveBest.ev))
+		xt.Save(bdg, mveBest, tevHigher, d, dLim, evStatic);
+	else
+		xt.Save(bdg, mveBest, tevEqual, d, dLim, evStatic);
+}
+
+
+/*	PLAI::EvBdgStaticXt
+ *
+ *	Static evaluation of the board, using the eval saved in the transposition
+ *	table if we have one. The saved eval is good no matter what depth it was
+ *	saved at, so this works even when FLookupXt couldn't use the entry.
+ * 
+ *	Random evals are only stable within a single search, so we can't trust saved
+ *	evals when randomness is turned on.
+ */
+EV PLAI::EvBdgStaticXt(BDG& bdg, const MVE& mvePrev) noexcept
+{
+	EV evStatic;
+	if (fecoRandom == 0 && xt.FFindEvStatic(bdg, evStatic))
+		return evStatic;
+	return EvBdgStatic(bdg, mvePrev);
+}
+
+
+/*	PLAI::InitRootNodes
+ *
+ *	Clears the count of nodes searched under each root move, which we do at 
+ *	the start of every iteration.
+ */
+void PLAI::InitRootNodes(void) noexcept
+{
+	memset(mpsqsqapccmveRoot, 0, sizeof(mpsqsqapccmveRoot));
+}
+
+
+/*	PLAI::SavePv
+ *
+ *	Saves the move that raised alpha at depth d as the start of the principal 
+ *	variation at that depth, followed by the PV the move's search left at the 
+ *	next depth. A nil move (from a stand pat) ends the PV.
+ */
+void PLAI::SavePv(int d, const MVE& mve) noexcept
+{
+	if (mve.fIsNil() || d + 1 >= dMax) {
+		acmvPV[d] = 0;
+		return;
+	}
+	amvPV[d][0] = mve;
+	int cmv = acmvPV[d + 1];
+	memcpy(&amvPV[d][1], &amvPV[d + 1][0], cmv * sizeof(MV));
+	acmvPV[d] = cmv + 1;
+}
+
+
+/*	PLAI::MvPvFollow
+ *
+ *	If the moves from the root of the search to the current board follow the PV 
+ *	of the last completed iteration, returns the next move of the PV. Otherwise
+ *	returns mvNil.
+ */
+MV PLAI::MvPvFollow(const BDG& bdg, int d) const noexcept
+{
+	if (d >= cmvPVRoot || bdg.imveCurLast != imveRoot + d)
+		return mvNil;
+	for (int imv = 0; imv < d; imv++)
+		if (bdg.vmveGame[imveRoot + 1 + imv] != amvPVRoot[imv])
+			return mvNil;
+	return amvPVRoot[d];
+}
+
+
+/*	PLAI::SaveKiller
+ *
+ *	Remember killer moves (non-captures that caused a beta cut-off), indexed by 
+ *	the ply of the search. Killer moves are used for improving move ordering 
+ *	by making a pretty good guess what moves are cut moves.
+ */
+void PLAI::SaveKiller(BDG& bdg, MVE mve, int d) noexcept
+{
+	if (mve.fIsCapture() || mve.apcPromote())
+		return;
+	MV* amvKiller = ass[d].amvKiller;
+	if (mve == amvKiller[0])
+		return;
+	for (int imv = cmvKillers-1; imv >= 1; imv--)
+		amvKiller[imv] = amvKiller[imv-1];
+	amvKiller[0] = mve;
+}
+
+
+/*	PLAI::InitSs
+ *
+ *	Clears the search stack at the start of a search. fInCheck is whether the root
+ *	position is in check.
+ */
+void PLAI::InitSs(bool fInCheck) noexcept
+{
+	for (int d = 0; d < dMax; d++)
+		ass[d].Init();
+	ass[0].fInCheck = fInCheck;
 }
 
 
-/*	PLAI::FLookupXt
+/*	PLAI::FImproving
  *
- *	Checks the transposition table for a board entry at the given search depth. Returns 
- *	true if we should stop the search at this point, either because we found an exact 
- *	match of the board/depth, or the inexact match is outside the alpha/beta interval.
+ *	Returns true if the static eval at ply d is better than it was the last time 
+ *	it was our move. Positions in check have no static eval, so we keep looking
+ *	back until we find one; if there is none, we assume we're improving.
+ */
+bool PLAI::FImproving(int d) const noexcept
+{
+	if (ass[d].fInCheck)
+		return false;
+	for (int dPrev = d - 2; dPrev >= 0; dPrev -= 2)
+		if (ass[dPrev].evStatic != evInf)
+			return ass[d].evStatic > ass[dPrev].evStatic;
+	return true;
+}
+
+
+/*	PLAI::SaveCutoff
  *
- *	mveBest will contain the evaluation we should use if we stop the search.
+ *	Updates the move ordering tables after mveCut caused a beta cut-off. A quiet
+ *	cut-off move becomes the counter move to the previous move, and gets a bump
+ *	in the continuation history, while all the other quiet moves we searched 
+ *	before it at this node get their continuation history lowered. Moves that 
+ *	were illegal or pruned without a search don't get penalized.
  */
-bool PLAI::FLookupXt(BDG& bdg, MVE& mveBest, AB ab, int d, int dLim) noexcept
+void PLAI::SaveCutoff(BDG& bdg, VMVES& vmves, const MVE& mveCut, int d, int dLim) noexcept
 {
-	/* look for the entry in the transposition table */
+	if (sint.load(memory_order_relaxed) != sintNull)
+		return;
+#ifndef NOSTATS
+	cmvCut++;
+	cmvCutFirst += vmves.cmvLegal == 1;
+#endif
+	if (mveCut.fIsCapture() || mveCut.apcPromote())
+		return;
 
-	XEV* pxev = xt.Find(bdg, d, dLim);
-	if (pxev == nullptr)
-		return false;
-	
-	/* adjust the value based on alpha-beta interval */
+	if (bdg.imveCurLast >= 0) {
+		const MVE& mvePrev = bdg.vmveGame[bdg.imveCurLast];
+		if (!mvePrev.fIsNil())
+			mppcsqmvCounter[mvePrev.pcMove()][mvePrev.sqTo()] = mveCut;
+	}
 
-	switch (pxev->tev()) {
-	case tevEqual:
-		mveBest.ev = pxev->ev(d);
-		break;
-	case tevHigher:
-		if (!ab.FEvIsAbove(pxev->ev(d)))
-			return false;
-		mveBest.ev = ab.evBeta;
-		break;
-	case tevLower:
-		if (!ab.FEvIsBelow(pxev->ev(d)))
-			return false;
-		mveBest.ev = ab.evAlpha;
-		break;
+	int dhist = min(32 * (dLim - d) * (dLim - d), 1200);
+	for (int cply = 1; cply <= 2; cply++) {
+		AddHistoryCont(PhistCont(bdg, cply, mveCut), dhist);
+		for (int imvu = 0; imvu < vmves.cmvuQuiet; imvu++) {
+			if (vmves.amvuQuiet[imvu] == mveCut)
+				continue;
+			AddHistoryCont(PhistCont(bdg, cply, vmves.amvuQuiet[imvu]), -dhist);
+		}
 	}
-	
-	mveBest.SetMvu(bdg.MveFromMv(pxev->mv()));
-	return true;
 }
 
 
-/*	PLAI::SaveXt
+/*	PLAI::PhistCont
  *
- *	Saves the evaluated board in the transposition table, including the depth,
- *	best move, and making sure we keep track of whether the eval was outside
- *	the a-b window.
+ *	Returns the continuation history entry of the move mvu, based on the game 
+ *	move cply plies before mvu. Returns nullptr if there is no such move.
  */
-XEV* PLAI::SaveXt(BDG& bdg, MVE mveBest, AB ab, int d, int dLim) noexcept
+int16_t* PLAI::PhistCont(const BDG& bdg, int cply, const MVU& mvu) noexcept
 {
-	/* don't save cancels or timeouts */
-	if (FEvIsInterrupt(mveBest.ev))
+	int imvePrev = bdg.imveCurLast + 1 - cply;
+	if (imvePrev < 0)
 		return nullptr;
-
-	if (ab.FEvIsBelow(mveBest.ev))
-		return xt.Save(bdg, mveBest, tevLower, d, dLim);
-	if (ab.FEvIsAbove(mveBest.ev))
-		return xt.Save(bdg, mveBest, tevHigher, d, dLim);
-	return xt.Save(bdg, mveBest, tevEqual, d, dLim);
+	const MVE& mvePrev = bdg.vmveGame[imvePrev];
+	if (mvePrev.fIsNil())
+		return nullptr;
+	return &mpcplypcsqpcsqhistCont[cply - 1][mvePrev.pcMove()][mvePrev.sqTo()][mvu.pcMove()][mvu.sqTo()];
 }
 
 
-/*	PLAI::SaveKiller
+/*	PLAI::AddHistoryCont
  *
- *	Remember killer moves (non-captures that caused a beta cut-off), indexed by 
- *	the move number of the game. Killer moves are used for improving move ordering 
- *	by making a pretty good guess what moves are cut moves.
+ *	Gravity-style continuation history update. The change shrinks as the entry
+ *	gets closer to its limit, so entries stay within +/-chistContMax without 
+ *	any explicit aging.
  */
-void PLAI::SaveKiller(BDG& bdg, MVE mve) noexcept
+void PLAI::AddHistoryCont(int16_t* phist, int dhist) noexcept
 {
-	if (mve.fIsCapture() || mve.apcPromote())
-		return;
-	int imveLim = bdg.imveCurLast + 1;
-	if (imveLim >= 256 || amvKillers[imveLim][0] == mve)
+	if (phist == nullptr)
 		return;
-	for (int imv = cmvKillers-1; imv >= 1; imv--)
-		amvKillers[imveLim][imv] = amvKillers[imveLim][imv-1];
-	amvKillers[imveLim][0] = mve;
+	*phist += dhist - *phist * abs(dhist) / chistContMax;
 }
 
 
@@ -980,8 +2002,11 @@ void PLAI::SubtractHistory(BDG& bdg, MVE mve) noexcept
 void PLAI::InitHistory(void) noexcept
 {
 	for (PC pc = 0; pc < pcMax; pc++)
-		for (SQ sqTo = 0; sqTo < sqMax; sqTo++)
+		for (SQ sqTo = 0; sqTo < sqMax; sqTo++) {
 			mppcsqcHistory[pc][sqTo] = 0;
+			mppcsqmvCounter[pc][sqTo] = mvNil;
+		}
+	memset(mpcplypcsqpcsqhistCont, 0, sizeof(mpcplypcsqpcsqhistCont));
 }
 
 
@@ -1020,13 +2045,14 @@ bool PLAI::FTryFutility(BDG& bdg, MVE& mveBest, EV evStatic, AB ab, int d, int d
 /*	PLAI::FTryStaticNullMove
  *
  *	If our static material score is so large that a big hit is still greater than 
- *	beta, we assume we're in a cut situation.
+ *	beta, we assume we're in a cut situation. The hit is a little smaller if our
+ *	position is improving.
  */
 bool PLAI::FTryStaticNullMove(BDG& bdg, MVE& mveBest, EV evStatic, AB ab, int d, int dLim, TS ts) noexcept
 {
 	if (ts & tsNoPruneNullMove)
 		return false;
-	EV devMargin = evPawn * (dLim - d);
+	EV devMargin = evPawn * (dLim - d) - (ass[d].fImproving ? evPawn / 2 : 0);
 	if (!ab.FEvIsAbove(evStatic - devMargin))
 		return false;
 	mveBest = MVE(mvuNil, evStatic - devMargin, tscEvOther);
@@ -1044,46 +2070,114 @@ bool PLAI::FTryStaticNullMove(BDG& bdg, MVE& mveBest, EV evStatic, AB ab, int d,
  *
  *	This trick doesn't work if we're in check because the null move would be illegal.
  *	Zugzwang positions violate the primary assumption - if either occur, this technique
- *	would cause improper evals.
+ *	would cause improper evals. Zugzwang mostly happens when the side to move only
+ *	has pawns left, so we don't try it then. Deep in the tree, where a bad prune is 
+ *	expensive, we verify the cut-off with a reduced depth search of the real 
+ *	position before we believe it.
+ *
+ *	The reduction grows with depth and with how far the static eval is above beta.
+ *	Only the depth part decides whether the node is deep enough to bother; the
+ *	eval part can take the reduced search all the way down to quiescence.
  *
  *	Returns true if we successfully found a pruning situation and search can be 
  *	stopped. We do not have a proper evaluated move in this situation, but we do have 
  *	a high/cut/prune evaluation.
  */
-bool PLAI::FTryNullMove(BDG& bdg, MVE& mveBest, AB ab, int d, int dLim, TS ts) noexcept
+bool PLAI::FTryNullMove(BDG& bdg, MVE& mveBest, EV evStatic, AB ab, int d, int dLim, TS ts) noexcept
 {
-	int R = 2 + (dLim - d) / 4;
-	if (d + 1 >= dLim - R ||			// don't bother if search is going this deep anyway
-		bdg.gph >= gphMidMax ||			// super lame zugzwang estimate
-		(ts & tsNoPruneNullMove))		// don't do null move inside null move
+	const int ddVerify = 10;	/* remaining depth where we start verifying */
+
+	if ((ts & tsNoPruneNullMove) ||		// don't do null move inside null move
+		evStatic < ab.evBeta ||			// unlikely to work if we're already losing
+		!bdg.FHasNonPawnMaterial(bdg.cpcToMove))	// zugzwang guard
+		return false;
+	int R = 3 + (dLim - d) / 4;
+	if (d + 1 >= dLim - R)				// don't bother if search is going this deep anyway
 		return false;
+	R += min((evStatic - ab.evBeta) / 200, 3);
+	int dLimNull = max(dLim - R, d + 1);
 
 	mveBest.SetMvu(mvuNil);
 	bdg.MakeMvNull();
-	mveBest.ev = -EvBdgSearch(bdg, mveBest, (-ab).AbNull(), d + 1, dLim - R, ts + tsNoPruneNullMove);
+	mveBest.ev = -EvBdgSearch(bdg, mveBest, (-ab).AbNull(), d + 1, dLimNull, ts + tsNoPruneNullMove);
 	bdg.UndoMv();
-	return ab.FEvIsAbove(mveBest.ev);
+	if (!ab.FEvIsAbove(mveBest.ev))
+		return false;
+
+	/* don't trust unproven mates from a null move search */
+	if (FEvIsMate(mveBest.ev))
+		mveBest.ev = ab.evBeta;
+	if (dLim - d < ddVerify)
+		return true;
+
+	/* verification search, with null moves turned off */
+#ifndef NOSTATS
+	cbdNullVerify++;
+#endif
+	VMVES vmves(bdg, this, d, ggAll + ggPseudo);
+	MVE mveVerify(mvuNil, -evInf);
+	int dLimVerify = dLimNull;
+	FSearchMveBest(bdg, vmves, mveVerify, AB(ab.evBeta - 1, ab.evBeta), d, dLimVerify, false, evStatic, ts + tsNoPruneNullMove);
+	if (ab.FEvIsAbove(mveVerify.ev))
+		return true;
+#ifndef NOSTATS
+	cbdNullVerifyFail++;
+#endif
+	return false;
 }
 
 
-EV mpdddevFutility[9] = {
-	0,
-	100, 
-	160, 
-	220, 
-	280, 
-	340, 
-	400, 
-	460, 
-	520
-};
+/*	PLAI::FTryProbCut
+ *
+ *	At deep cut nodes, if a good capture gets us well above beta with a much 
+ *	shallower search, a full depth search would almost certainly cut off too. We
+ *	try each good capture with a quiescent search against the raised beta first, 
+ *	and only do the reduced depth search if that holds up.
+ * 
+ *	We don't have a real static exchange evaluator, so good captures are the 
+ *	ones FLosingCapture doesn't think lose material.
+ */
+bool PLAI::FTryProbCut(BDG& bdg, MVE& mveBest, AB ab, int d, int dLim, TS ts) noexcept
+{
+	const int ddProbCutMin = 5;
+	const int ddProbCutReduce = 4;
+
+	if ((ts & tsNoPruneProbCut) || dLim - d < ddProbCutMin || !ab.fIsNull())
+		return false;
+	if (FEvIsMate(ab.evBeta) || FEvIsMate(-ab.evBeta) || ab.evBeta + devProbCut >= evMateMin)
+		return false;
+
+	AB abCut = AB(ab.evBeta + devProbCut - 1, ab.evBeta + devProbCut);
+	VMVES vmves(bdg, this, d, ggPseudo + ggNoisy);
+	for (MVE* pmve = nullptr; vmves.FEnumMvNext(bdg, pmve); ) {
+		if (FLosingCapture(*pmve) || (!pmve->fIsCapture() && !pmve->apcPromote())) {
+			vmves.UndoMv(bdg);
+			continue;
+		}
+		EV ev = -EvBdgQuiescent(bdg, *pmve, -abCut, d + 1, ts);
+		if (abCut.FEvIsAbove(ev))
+			ev = -EvBdgSearch(bdg, *pmve, -abCut, d + 1, dLim - ddProbCutReduce, ts + tsNoPruneProbCut);
+		vmves.UndoMv(bdg);
+		if (sint.load(memory_order_relaxed) != sintNull)
+			return false;
+		if (abCut.FEvIsAbove(ev)) {
+#ifndef NOSTATS
+			cbdProbCut++;
+#endif
+			mveBest = MVE(*pmve, ab.evBeta, tscGoodCapture);
+			return true;
+		}
+	}
+	return false;
+}
 
 
 /*	PLAI::FTryRazoring
  *
  *	If we're near the horzion and static evaluation is terrible, try a quick 
  *	quiescent search to see if we'll probably fail low. If qsearch fails low, 
- *	it probably knows what it's talking about, so bail out and return alpha.  
+ *	it probably knows what it's talking about, so bail out and return alpha. 
+ *	Positions that are improving need to be even more terrible before we try.
  */
 bool PLAI::FTryRazoring(BDG& bdg, MVE& mveBest, EV evStatic, AB ab, int d, int dLim, TS ts) noexcept
 {
@@ -1091,7 +2185,7 @@ bool PLAI::FTryRazoring(BDG& bdg, MVE& mveBest, EV evStatic, AB ab, int d, int d
 		return false;
 
 	assert(dLim-d < CArray(mpdddevFutility));
-	EV dev = 3 * mpdddevFutility[dLim-d];
+	EV dev = 3 * mpdddevFutility[dLim-d] + (ass[d].fImproving ? evPawn : 0);
 	if (ab.FEvIsBelow(evStatic + dev)) {
 		EV ev = EvBdgQuiescent(bdg, mveBest, ab, d, ts);
 		if (ab.FEvIsBelow(ev)) {
@@ -1111,8 +2205,12 @@ bool PLAI::FTryRazoring(BDG& bdg, MVE& mveBest, EV evStatic, AB ab, int d, int d
  * 
  *	Also returns true if the search should be interrupted for some reason. pmve->ev will 
  *	be modified with the reason for the interruption.
+ * 
+ *	Quiescent search passes fQuiescent, which leaves the killer and history 
+ *	tables alone. Its quiet moves are check evasions searched to an arbitrary 
+ *	depth, which would swamp the main search's move ordering.
  */
-bool PLAI::FPrune(BDG& bdg, MVE &mve, MVE& mveBest, AB& ab, int d, int& dLim) noexcept
+bool PLAI::FPrune(BDG& bdg, MVE &mve, MVE& mveBest, AB& ab, int d, int& dLim, bool fQuiescent) noexcept
 {
 	/* keep track of best move */
 
@@ -1123,7 +2221,8 @@ bool PLAI::FPrune(BDG& bdg, MVE &mve, MVE& mveBest, AB& ab, int d, int& dLim) no
 
 	if (ab.FEvIsAbove(mve.ev)) {
 		mveBest = mve;
-		SaveKiller(bdg, mveBest);
+		if (!fQuiescent)
+			SaveKiller(bdg, mveBest, d);
 		return true;
 	}
 
@@ -1135,14 +2234,16 @@ bool PLAI::FPrune(BDG& bdg, MVE &mve, MVE& mveBest, AB& ab, int d, int& dLim) no
 		ab.RaiseAlpha(mve.ev);
 		if (FEvIsMate(mve.ev))	
 			dLim = DFromEvMate(mve.ev);
-		AddHistory(bdg, mve, d, dLim);
+		if (!fQuiescent)
+			AddHistory(bdg, mve, d, dLim);
+		SavePv(d, mve);
 	}
 
-	/* If Esc is hit (set by message pump), or if we're taking too damn long to do
-	   the search, force the search to prune all the way back to root, where we'll 
-	   abort the search */
+	/* If Esc is hit (set by the UI thread), or if we're taking too damn long to do
+	   the search (set by time management), force the search to prune all the way 
+	   back to root, where we'll abort the search */
 
-	if (sint != sintNull) {
+	if (sint.load(memory_order_relaxed) != sintNull) {
 		mve.ev = mveBest.ev = (sint == sintCanceled) ? evCanceled : evTimedOut;
 		mveBest.SetMvu(mvuNil);
 		return true;
@@ -1204,8 +2305,14 @@ bool PLAI::FDeepen(BDG& bdg, MVE mveBest, AB& ab, int& d) noexcept
 		   a-b window (the aspiration window optimization) at first in hopes we'll 
 		   get lots of pruning */
 
+		ScaleDeadline(mveBest);
 		mveBestOverall = mveBest;
+		fBestOverall = true;
+		cmvPVRoot = acmvPV[0];
+		memcpy(amvPVRoot, amvPV[0], cmvPVRoot * sizeof(MV));
 		LogInfo(bdg, mveBestOverall.ev, d, dSel);
+		for (int ipv = 1; ipv < cpvMultiCur; ipv++)
+			LogInfo(bdg, amveMulti[ipv].ev, dPvMulti, dSel, ipv);
 		if (FEvIsMate(mveBest.ev) || FEvIsMate(-mveBest.ev))
 			return false;
 		ab = ab.AbAspiration(mveBest.ev, 20);
@@ -1219,13 +2326,17 @@ bool PLAI::FDeepen(BDG& bdg, MVE mveBest, AB& ab, int& d) noexcept
  *
  *	Gets us ready for the intelligence that will determine how long we spend analyzing the
  *	move. Time management happens in two places: during the main iterative deepening loop,
- *	and as an interrupt on the clock tick. 
+ *	and as an interrupt checked by the search every so many nodes. 
  * 
  *	This basically sets a deadline. If we ever exceed this deadline in the iterative 
  *	deepening, we immediately stop the search. However, the iterative deepening loop may 
- *	not have control for minutes at a time. So, on the clock tick, we also check; but 
+ *	not have control for minutes at a time. So, during the search, we also check; but 
  *	we'll let the AI think quite a ways past the deadline if we're in the middle of a long
  *	search.
+ * 
+ *	With smart time management, the deadline is a soft limit that gets scaled after
+ *	every iteration by how stable the search is, while the interrupt enforces a hard 
+ *	limit.
  */
 void PLAI::InitTimeMan(BDG& bdg) noexcept
 {
@@ -1233,11 +2344,23 @@ void PLAI::InitTimeMan(BDG& bdg) noexcept
 		msecHalfSec, 1*msecSec, 2*msecSec, 5*msecSec, 10*msecSec, 15*msecSec, 30*msecSec,
 		1*msecMin, 2*msecMin, 5*msecMin
 	};
+	static const uint64_t mplevelcmve[] = { 0,
+		10000, 25000, 50000, 100000, 250000, 500000, 1000000,
+		2500000, 5000000, 10000000
+	};
 
 	/* for constant depth time management, leave the flag variable -1 */
 
 	dmsecFlag = -1;
+	dmsecOverhead = dmsecMoveOverhead + dmsecLatency;
+	dmsecStop = 0;
 	tpMoveStart = high_resolution_clock::now();
+	tpCheck = tpMoveStart;
+	cmveCheck = 1;
+	dLimPredict = 0;
+	dmsecDepthStart = dmsecDepthPrev = 0;
+	cmveDepthStart = cmveDepthPrev = 0;
+	cmveMove = 0;
 	
 	switch (ttm) {
 	default:
@@ -1245,6 +2368,7 @@ void PLAI::InitTimeMan(BDG& bdg) noexcept
 	case ttmSmart:
 		if (!ga.prule->FUntimed()) {
 			dmsecFlag = ga.DmsecRemaining(bdg.cpcToMove);
+			DWORD dmsecAvail = dmsecFlag > dmsecOverhead ? dmsecFlag - dmsecOverhead : 0;
 			int nmvCur = ga.bdg.vmveGame.NmvFromImv(bdg.imveCurLast+1);	/* move number of the move we're about to make */
 			int nmvFlag = ga.prule->TmiFromNmv(nmvCur).nmvLast;	/* move number we must make before we flag */
 			DWORD dmsecMove = ga.prule->DmsecAddMove(bdg.cpcToMove, nmvCur);
@@ -1254,18 +2378,46 @@ void PLAI::InitTimeMan(BDG& bdg) noexcept
 			if (nmvFlag > 0)
 				dnmv = min(dnmv, nmvFlag - nmvCur + 1);
 			assert(dnmv > 0);
-			dmsecDeadline = min(dmsecFlag/dnmv + dmsecMove, dmsecFlag);
+			dmsecDeadline = min(dmsecAvail/dnmv + dmsecMove, dmsecAvail);
 			dmsecDeadline = min(dmsecDeadline, mpleveldmsec[level]);
-			LogData(wjoin(L"Time target:", SzCommaFromLong(dmsecDeadline), L"ms"));
+			dmsecSoft = dmsecDeadline;
+			dmsecHard = max(dmsecDeadline, min(3*dmsecDeadline, dmsecAvail/3));
+			pctBestChange = 0;
+			/* when we're almost out of time, play the first move we find */
+			if (dmsecAvail < max((DWORD)msecSec, 10*dmsecOverhead)) {
+				dmsecDeadline = dmsecSoft = dmsecHard = 0;
+				if (fLog)
+					LogData(wjoin(L"Emergency time:", SzCommaFromLong(dmsecFlag), L"ms left"));
+			}
+			if (fLog)
+				LogData(wjoin(L"Time target:", SzCommaFromLong(dmsecDeadline), L"ms", 
+							  L"overhead", SzCommaFromLong(dmsecOverhead), L"ms"));
 			break;
 		}
 		/* games without clocks just use a constant time per move */
 		ttm = ttmTimePerMove;
 		[[fallthrough]];
 	case ttmTimePerMove:
-		dmsecDeadline = mpleveldmsec[level];
+		dmsecDeadline = dmsecSoft = mpleveldmsec[level];
+		dmsecHard = dmsecDeadline + dmsecDeadline/2;
 		break;
+	case ttmConstNodes:
+		cmveDeadline = cmveLimit ? cmveLimit : mplevelcmve[level];
+		if (fLog)
+			LogData(wjoin(L"Node target:", SzCommaFromLong(cmveDeadline)));
+		break;
+	}
+
+	/* time we've already used on this move, before the search started, comes off 
+	   the clock and the deadlines, since our move timer starts over here */
+	if (dmsecPreSearch > 0 && (ttm == ttmSmart || ttm == ttmTimePerMove)) {
+		if (dmsecFlag != (DWORD)-1)
+			dmsecFlag = dmsecFlag > dmsecPreSearch ? dmsecFlag - dmsecPreSearch : 0;
+		dmsecDeadline = dmsecDeadline > dmsecPreSearch ? dmsecDeadline - dmsecPreSearch : 0;
+		dmsecSoft = dmsecSoft > dmsecPreSearch ? dmsecSoft - dmsecPreSearch : 0;
+		dmsecHard = dmsecHard > dmsecPreSearch ? dmsecHard - dmsecPreSearch : 0;
 	}
+	dmsecPreSearch = 0;
 }
 
 
@@ -1302,15 +2454,23 @@ bool PLAI::FBeforeDeadline(int dLim) noexcept
 {
 	if (mveBestOverall.fIsNil())
 		return true;
+	if (fPonder)
+		return dLim < dMax / 2;
 
 	switch (ttm) {
 
 	case ttmSmart:
 	case ttmTimePerMove:
-		return DmsecMoveSoFar() < dmsecDeadline;
+	{
+		/* don't start a new depth we don't expect to finish */
+		DWORD dmsec = DmsecMoveSoFar();
+		return dmsec + DmsecPredictDepth(dLim, dmsec) < dmsecSoft;
+	}
 	case ttmConstDepth:
 		/* different levels get different depths */
-		return dLim <= level;
+		return dLim <= (dLimit ? dLimit : level);
+	case ttmConstNodes:
+		return CmveMoveSoFar() < cmveDeadline;
 	case ttmInfinite:
 		return true;
 	}
@@ -1319,12 +2479,185 @@ bool PLAI::FBeforeDeadline(int dLim) noexcept
 }
 
 
+/*	PLAI::ScaleDeadline
+ *
+ *	Smart time management, called after every successful iteration with the 
+ *	iteration's best move, before it becomes the best overall move. Scales the 
+ *	soft deadline up when the best move keeps changing, when the score is 
+ *	dropping, and when the best move didn't take most of the root's nodes to
+ *	search, which are all signs the position is hard. An easy move, where the
+ *	search keeps agreeing with itself, gets less time. 
+ */
+void PLAI::ScaleDeadline(const MVE& mveBest) noexcept
+{
+	if (ttm != ttmSmart || mveBestOverall.fIsNil())
+		return;
+
+	/* best move changes, which decay by half each iteration */
+
+	pctBestChange = pctBestChange/2 + (mveBest != mveBestOverall ? 100 : 0);
+	int pctStable = 100 + pctBestChange*8/10;
+
+	/* dropping scores */
+
+	int pctDrop = clamp(100 + (mveBestOverall.ev - mveBest.ev)*2/3, 80, 160);
+
+	/* fraction of the root's nodes spent on the best move */
+
+	uint64_t cmveRoot = 0;
+	for (int sqFrom = 0; sqFrom < sqMax; sqFrom++)
+		for (int sqTo = 0; sqTo < sqMax; sqTo++)
+			for (int apc = 0; apc < apcMax; apc++)
+				cmveRoot += mpsqsqapccmveRoot[sqFrom][sqTo][apc];
+	int pctNodes = 100;
+	if (cmveRoot > 0)
+		pctNodes = 150 - (int)(CmveRoot(mveBest) * 100 / cmveRoot);
+
+	uint64_t dmsec = (uint64_t)dmsecDeadline * pctStable * pctDrop * pctNodes / (100*100*100);
+	dmsecSoft = (DWORD)min(dmsec, (uint64_t)dmsecHard);
+}
+
+
+/*	PLAI::DmsecPredictDepth
+ *
+ *	Predicts how long it will take to search the next depth dLim of iterative 
+ *	deepening, when dmsec has elapsed. We scale the time the last depth took by 
+ *	the effective branching factor, which we measure by the growth in nodes 
+ *	between the last two depths, or by the growth in time if we aren't keeping 
+ *	stats. Returns 0 if we're re-searching the same depth after an aspiration 
+ *	window miss.
+ */
+DWORD PLAI::DmsecPredictDepth(int dLim, DWORD dmsec) noexcept
+{
+	if (dLim == dLimPredict)
+		return 0;
+
+	DWORD dmsecDepth = dmsec - dmsecDepthStart;
+	uint64_t cmve = CmveMoveSoFar();
+	uint64_t cmveDepth = cmve - cmveDepthStart;
+	int pctEbf = 300;
+	if (cmveDepthPrev > 0)
+		pctEbf = (int)min(cmveDepth * 100 / cmveDepthPrev, (uint64_t)1000);
+	else if (dmsecDepthPrev > 0)
+		pctEbf = (int)min((uint64_t)dmsecDepth * 100 / dmsecDepthPrev, (uint64_t)1000);
+	pctEbf = clamp(pctEbf, 150, 800);
+
+	dLimPredict = dLim;
+	dmsecDepthStart = dmsec;
+	dmsecDepthPrev = dmsecDepth;
+	cmveDepthStart = cmve;
+	cmveDepthPrev = cmveDepth;
+	return (DWORD)((uint64_t)dmsecDepth * pctEbf / 100);
+}
+
+
+/*	PLAI::MeasureLatency
+ *
+ *	Measures the time from when we decided to stop searching until we have the
+ *	move ready to return, which includes unwinding the search and stopping the 
+ *	helper threads. It's measured before we log the move, so log and UI time 
+ *	doesn't get counted as move overhead. Keeps a running estimate that rises immediately to a slow move 
+ *	and decays slowly, which we add to the move overhead on subsequent moves.
+ */
+void PLAI::MeasureLatency(void) noexcept
+{
+	if (dmsecStop == 0 || sint == sintCanceled)
+		return;
+	DWORD dmsec = DmsecMoveSoFar() - dmsecStop;
+	if (dmsec > dmsecLatency)
+		dmsecLatency = dmsec;
+	else
+		dmsecLatency = (7*dmsecLatency + dmsec) / 8;
+	dmsecLatency = min(dmsecLatency, (DWORD)msecSec);
+}
+
+
 DWORD PLAI::DmsecMoveSoFar(void) const noexcept
 {
 	time_point<high_resolution_clock> tp = high_resolution_clock::now();
 	duration dtp = tp - tpMoveStart;
 	milliseconds dmsec = duration_cast<milliseconds>(dtp);
-	return (DWORD)dmsec.count();
+	return (DWORD)dmsec.count() - dmsecPonder;
+}
+
+
+/*	PLAI::CmveMoveSoFar
+ *
+ *	Number of nodes, main and quiescent, our own thread has searched on this
+ *	move, including the iteration in progress. Works with stats turned off.
+ */
+uint64_t PLAI::CmveMoveSoFar(void) const noexcept
+{
+	return cmveMove;
+}
+
+
+/*	PLAI::CheckInterrupt
+ *
+ *	Called by the search on every node. Time management needs the clock, so we 
+ *	only check it every cmveCheck nodes; the interrupt, if any, is left in sint 
+ *	where the search will see it.
+ */
+void PLAI::CheckInterrupt(void) noexcept
+{
+	cmveMove++;
+	if (--cmveCheck > 0)
+		return;
+	CheckTimeMan();
+}
+
+
+/*	PLAI::CheckTimeMan
+ *
+ *	The slow part of the search interrupt check. The number of nodes between 
+ *	checks is a power of two, which we adapt so we check about once a 
+ *	millisecond; that keeps the stop latency well under the 5ms we need for 
+ *	bullet games, while reading the clock a thousand times a second costs next 
+ *	to nothing. 
+ * 
+ *	Constant nodes searches count down exactly to the node budget, so we 
+ *	interrupt at exactly the same node every time we search the same position, 
+ *	no matter how fast the machine is. 
+ * 
+ *	Helper threads are stopped by the main thread, so they never check.
+ */
+void PLAI::CheckTimeMan(void) noexcept
+{
+	const int lgcmveCheckMin = 4;
+	const int lgcmveCheckMax = 20;
+
+	if (fHelper) {
+		cmveCheck = INT_MAX;
+		return;
+	}
+
+	time_point<high_resolution_clock> tp = high_resolution_clock::now();
+	long long dusec = duration_cast<microseconds>(tp - tpCheck).count();
+	tpCheck = tp;
+	if (dusec < 500 && lgcmveCheck < lgcmveCheckMax)
+		lgcmveCheck++;
+	else if (dusec > 2000 && lgcmveCheck > lgcmveCheckMin)
+		lgcmveCheck--;
+	cmveCheck = 1 << lgcmveCheck;
+
+	if (sint.load(memory_order_relaxed) != sintNull)
+		return;
+	SINT sintNew = SintTimeMan();
+	if (sintNew != sintNull) {
+		dmsecStop = DmsecMoveSoFar();
+		sint.store(sintNew, memory_order_relaxed);
+	}
+
+	/* constant nodes searches count down to the budget; if we've run out before 
+	   we have a best move, we check every node until we get one */
+
+	if (ttm == ttmConstNodes)
+		cmveCheck = cmveMove < cmveDeadline ? (int)min(cmveDeadline - cmveMove, (uint64_t)1 << lgcmveCheckMax) : 1;
+
+#ifndef NOSTATS
+	cTimeMan++;
+	dnsecTimeMan += duration_cast<nanoseconds>(high_resolution_clock::now() - tp).count();
+#endif
 }
 
 
@@ -1344,53 +2677,35 @@ SINT PLAI::SintTimeMan(void) const noexcept
 	if (!ga.bdg.FGsPlaying())
 		return sintCanceled;
 
+	/* pondering is on the opponent's time */
+
+	if (fPonder)
+		return sintNull;
+
 	/* if we're doing constant depth search, we do no time management; we also must
 	   have a possible best move before we can interrupt */
 
-	if (ttm == ttmConstDepth || ttm == ttmInfinite || mveBestOverall.fIsNil())
+	if (ttm == ttmConstDepth || ttm == ttmInfinite || !fBestOverall)
 		return sintNull;
+	if (ttm == ttmConstNodes)
+		return cmveMove >= cmveDeadline ? sintTimedOut : sintNull;
 	
-	/* the deadline is just a suggestion - we'll actually abort the search if we go
-	   50% beyond it */
+	/* the deadline is just a suggestion - we'll actually abort the search when we
+	   hit the hard limit */
 
 	DWORD dmsec = DmsecMoveSoFar();
-	if (dmsec > dmsecDeadline + dmsecDeadline / 2)
+	if (dmsec > dmsecHard)
 		return sintTimedOut;
 
-	/* if we're within a half-second of flagging, bail out right away */
+	/* if we're about to flag, once we allow for the overhead of getting the move 
+	   to the clock, bail out right away */
 
-	if (dmsecFlag != -1 && dmsec > dmsecFlag - msecHalfSec)
+	if (dmsecFlag != -1 && dmsec + dmsecOverhead >= dmsecFlag)
 		return sintTimedOut;
 	return sintNull;
 }
 
 
-/*	PLAI::PumpMsg
- *
- *	Temporary message pump to keep the UI working while the AI is thinking.
- *	Eventually we'll modify the search to run in a dedicated thread and we won't
- *	need this any more.
- * 
- *	If the user aborts the AI by hitting Esc, it sets a flag in the player to 
- *	cancel the AI. The flag is checked in the pruning code, which causes a 
- *	cascade of pruning and we then abort at the top level of the search.
- */
-void PLAI::PumpMsg(bool fForce) noexcept
-{
-	if (fForce)
-		cYield = -1;
-	if (++cYield % dcYield)
-		return;
-	try {
-		ga.puiga->PumpMsg();
-		sint = SintTimeMan();
-	}
-	catch (...) {
-		sint = sintCanceled;
-	}
-}
-
-
 /*	PLAI::EvTempo
  *
  *	The value of a tempo, used in board static evaluation.
@@ -1486,11 +2801,10 @@ EV PLAI::ScoreMove(BDG& bdg, MVE mvePrev) noexcept
  *	approximate a normal EV, it is not directly comparable, and should only
  *	be compared to other killer move scores.
  */
-bool PLAI::FScoreKiller(BDG& bdg, MVE& mve) noexcept
+bool PLAI::FScoreKiller(BDG& bdg, MVE& mve, int d) noexcept
 {
-	int imveLim = bdg.imveCurLast + 1;
 	for (int imv = 0; imv < cmvKillers; imv++) {
-		if (amvKillers[imveLim][imv] == mve) {
+		if (mve == ass[d].amvKiller[imv]) {
 			mve.ev = evPawn - 10 * imv;
 			return true;
 		}
@@ -1499,11 +2813,41 @@ bool PLAI::FScoreKiller(BDG& bdg, MVE& mve) noexcept
 }
 
 
+/*	PLAI::FScoreCounter
+ *
+ *	Scores the counter move to the previous move, which is the quiet move that 
+ *	last caused a beta cut-off in reply to it. Counter moves are scored just below 
+ *	the killers. Returns true if the move is the counter move.
+ */
+bool PLAI::FScoreCounter(BDG& bdg, MVE& mve) noexcept
+{
+	if (bdg.imveCurLast < 0)
+		return false;
+	const MVE& mvePrev = bdg.vmveGame[bdg.imveCurLast];
+	if (mvePrev.fIsNil() || mve != mppcsqmvCounter[mvePrev.pcMove()][mvePrev.sqTo()])
+		return false;
+	mve.ev = evPawn - 10 * cmvKillers;
+	return true;
+}
+
+
+/*	PLAI::FScoreHistory
+ *
+ *	Scores quiet moves by their history, which is the sum of the plain history 
+ *	table and the 1- and 2-ply continuation histories. Returns false if the 
+ *	move has no good history.
+ */
 bool PLAI::FScoreHistory(BDG& bdg, MVE& mve) noexcept
 {
-	if (mppcsqcHistory[bdg.PcFromSq(mve.sqFrom())][mve.sqTo()] == 0)
+	int hist = mppcsqcHistory[bdg.PcFromSq(mve.sqFrom())][mve.sqTo()];
+	for (int cply = 1; cply <= 2; cply++) {
+		int16_t* phist = PhistCont(bdg, cply, mve);
+		if (phist)
+			hist += *phist;
+	}
+	if (hist <= 0)
 		return false;
-	mve.ev = mppcsqcHistory[bdg.PcFromSq(mve.sqFrom())][mve.sqTo()];
+	mve.ev = (EV)min(hist, (int)evMateMin);
 	return true;
 }
 
@@ -1512,9 +2856,16 @@ bool PLAI::FScoreHistory(BDG& bdg, MVE& mve) noexcept
  *
  *	Evaluates the board from the point of view of the color with the 
  *	move. Previous move is in mvevPrev, which should be pre-populated  
+ * 
+ *	Results are remembered in the eval cache, so positions that come up again
+ *	don't need to be re-evaluated.
  */
 EV PLAI::EvBdgStatic(BDG& bdg, MVE mvePrev) noexcept
 {
+	EV ev;
+	if (evc.FFind(bdg, ev))
+		return ev;
+
 	EV evPsqt = 0, evMaterial = 0, evMobility = 0, evKingSafety = 0, evPawnStructure = 0;
 	EV evTempo = 0, evRandom = 0;
 
@@ -1556,14 +2907,17 @@ EV PLAI::EvBdgStatic(BDG& bdg, MVE mvePrev) noexcept
 		evPawnStructure = evPawnToMove - evPawnDef;
 	}
 	
-	EV ev = (fecoPsqt * evPsqt +
-			 fecoMaterial * evMaterial +
-			 fecoMobility * evMobility +
-			 fecoKingSafety * evKingSafety +
-			 fecoPawnStructure * evPawnStructure +
-			 fecoTempo * evTempo +
-			 evRandom +
-			 fecoScale/2) / fecoScale;
+	ev = (fecoPsqt * evPsqt +
+		  fecoMaterial * evMaterial +
+		  fecoMobility * evMobility +
+		  fecoKingSafety * evKingSafety +
+		  fecoPawnStructure * evPawnStructure +
+		  fecoTempo * evTempo +
+		  evRandom +
+		  fecoScale/2) / fecoScale;
+	evc.Save(bdg, ev);
+	if (!fLog)
+		return ev;
 
 #ifdef EVALSTATS
 	LogData(bdg.cpcToMove == cpcWhite ? L"White" : L"Black");
@@ -1854,6 +3208,21 @@ PLAI2::PLAI2(GA& ga) : PLAI(ga)
 }
 
 
+/*	PLAI2::PLAI2
+ *
+ *	Helper search thread constructor.
+ */
+PLAI2::PLAI2(PLAI2& plaiMain) : PLAI(plaiMain)
+{
+}
+
+
+PLAI* PLAI2::PplaiHelperNew(void)
+{
+	return new PLAI2(*this);
+}
+
+
 void PLAI2::InitWeightTables(void)
 {
 	InitWeightTable(mpapcevOpening2, mpapcsqdevOpening2, mpapcsqevOpening);
@@ -1862,6 +3231,101 @@ void PLAI2::InitWeightTables(void)
 }
 
 
+/*
+ *
+ *	PLPNS class
+ * 
+ *	The AI with a proof-number search mate solver bolted on the front.
+ * 
+ */
+
+
+PLPNS::PLPNS(GA& ga) : PLAI(ga)
+{
+	SetName(L"AI (Mate Solver)");
+}
+
+
+/*	PLPNS::MveGetNext
+ *
+ *	Runs the mate solver first, and plays the mate if it finds one. Otherwise 
+ *	we do a regular AI search with whatever time we have left, so the time the
+ *	solver used is charged to the search's time management. The solver runs
+ *	on its own thread so the UI keeps going and Esc still cancels. Ponder 
+ *	searches skip the solver, since they have to keep searching until the 
+ *	opponent moves anyway.
+ */
+MVE PLPNS::MveGetNext(SPMV& spmv) noexcept
+{
+	if (fPonder)
+		return PLAI::MveGetNext(spmv);
+
+	spmv = spmvAnimate;
+	sint = sintNull;
+	tpMoveStart = high_resolution_clock::now();
+	dmsecPonder = 0;
+	cmveMove = 0;
+	bool fMate = false;
+	thread thdSolve([this, &fMate]() { fMate = FSolveMate(); });
+	WaitSearch(thdSolve);
+	thdSolve.join();
+
+	if (fMate) {
+		/* report the mate just like a search result */
+		MVE mve = ga.bdg.MveFromMv(pns.vmvMate[0]);
+		mve.ev = EvMate((int)pns.vmvMate.size());
+		cmvPVRoot = min((int)pns.vmvMate.size(), dMax);
+		copy(pns.vmvMate.begin(), pns.vmvMate.begin() + cmvPVRoot, amvPVRoot);
+		cmveMove = pns.cpnnExpand;
+		LogBestMove(ga.bdg, mve, cmvPVRoot, cmvPVRoot);
+		return mve;
+	}
+	if (pns.pnsr == pnsrCanceled)
+		return MVE(mvuNil, -evInf);
+	dmsecPreSearch = pns.dmsecSolve;
+	return PLAI::MveGetNext(spmv);
+}
+
+
+/*	PLPNS::FSolveMate
+ *
+ *	Looks for a forced mate in the current game position, with the mate depth 
+ *	based on the AI level. Returns true if we found one.
+ */
+bool PLPNS::FSolveMate(void)
+{
+	pns.cmvMateMax = max(level, 1);
+	pns.dmsecMax = DmsecMateBudget();
+	pns.pfnInterrupt = [this]() { return sint != sintNull; };
+
+	LogOpen(L"Mate Search", wjoin(L"mate in", pns.cmvMateMax), lgfNormal);
+	bool fMate = pns.FSolve(ga.bdg);
+	wstring szLine;
+	for (MV mv : pns.vmvMate)
+		szLine += L" " + to_wstring(mv);
+	LogData(wjoin(L"Nodes:", SzCommaFromLong(pns.cpnnUsed), 
+				  L"Expanded:", SzCommaFromLong(pns.cpnnExpand),
+				  L"Time:", SzCommaFromLong(pns.dmsecSolve), L"ms"));
+	LogClose(L"Mate Search", to_wstring(pns.pnsr) + szLine, lgfNormal);
+	return fMate;
+}
+
+
+/*	PLPNS::DmsecMateBudget
+ *
+ *	How much time we're willing to give the mate solver. It's a small slice of
+ *	what the regular search would get, because most of the time there isn't a
+ *	mate to find.
+ */
+DWORD PLPNS::DmsecMateBudget(void) const noexcept
+{
+	DWORD dmsec = max(level, 1) * msecSec / 4;
+	if (!ga.prule->FUntimed())
+		dmsec = min(dmsec, ga.DmsecRemaining(ga.bdg.cpcToMove) / 50);
+	return dmsec;
+}
+
+
 /*
  *
  *	PLHUMAN class
@@ -1912,6 +3376,7 @@ AINFOPL::AINFOPL(void)
 	vinfopl.push_back(INFOPL(clplAI2, tplAI, L"AI2", IfDebugElse(ttmConstDepth, ttmSmart), 3));
 	vinfopl.push_back(INFOPL(clplAI, tplAI, L"AI (Infinite)", ttmInfinite, 10));
 	vinfopl.push_back(INFOPL(clplAI, tplAI, L"AI (Depth)", ttmConstDepth, 5));
+	vinfopl.push_back(INFOPL(clplPNS, tplAI, L"AI (Mate Solver)", IfDebugElse(ttmConstDepth, ttmSmart), 5));
 	vinfopl.push_back(INFOPL(clplHuman, tplHuman, L"Rick Powell"));
 	vinfopl.push_back(INFOPL(clplHuman, tplHuman, L"Hazel"));
 }
@@ -1932,6 +3397,9 @@ PL* AINFOPL::PplFactory(GA& ga, int iinfopl) const
 	case clplAI2:
 		ppl = new PLAI2(ga);
 		break;
+	case clplPNS:
+		ppl = new PLPNS(ga);
+		break;
 	case clplHuman:
 		ppl = new PLHUMAN(ga, vinfopl[iinfopl].szName);
 		break;
@@ -1966,6 +3434,8 @@ wstring to_wstring(TTM ttm)
 	switch (ttm) {
 	case ttmConstDepth:
 		return L"Constant Depth";
+	case ttmConstNodes:
+		return L"Constant Nodes";
 	case ttmTimePerMove:
 		return L"Constant Time";
 	case ttmSmart:
@@ -1984,6 +3454,8 @@ wstring to_wstring(CLPL clpl)
 		return L"AI";
 	case clplAI2:
 		return L"AI2";
+	case clplPNS:
+		return L"Mate Solver";
 	case clplHuman:
 		return L"Human";
 	default:
@@ -10,6 +10,7 @@
 #include "ui.h"
 #include "bd.h"
 #include "xt.h"
+#include "pns.h"
 
 
  /*
@@ -83,7 +84,24 @@ public:
 	virtual int Level(void) const noexcept { return -1; }
 	virtual void SetLevel(int level) noexcept { }
 	virtual void SetTtm(TTM ttm) noexcept { }
+	virtual void SetCmveLimit(uint64_t cmveLimit) noexcept { }
+	virtual void SetDLimit(int dLimit) noexcept { }
+	virtual void SetDmsecMoveOverhead(DWORD dmsecMoveOverhead) noexcept { }
+	virtual void SetCpvMulti(int cpvMulti) noexcept { }
+	virtual void SetDevProbCut(EV devProbCut) noexcept { }
 	virtual void SetFecoRandom(uint16_t) noexcept { }
+	virtual int Cthd(void) const noexcept { return 1; }
+	virtual void SetCthd(int cthd) noexcept { }
+	virtual uint64_t CmveSearched(void) const noexcept { return 0; }
+
+	virtual void SetPonder(bool fPonder) noexcept { }
+	virtual void PonderHit(void) noexcept { }
+	virtual void StopSearch(void) noexcept { }
+	virtual MV MvPonder(void) const noexcept { return mvNil; }
+
+	virtual bool FHasXt(void) const noexcept { return false; }
+	virtual void SaveXtFile(const wstring& szFile) { }
+	virtual void LoadXtFile(const wstring& szFile) { }
 
 	virtual EV EvFromGphApcSq(GPH gph, APC apc, SQ sq) const noexcept;
 	virtual EV EvBaseApc(APC apc) const noexcept;
@@ -117,12 +135,25 @@ public:
 	PLAI* pplai;
 	int d;
 	TSC tscCur;	/* the score type we're currently enumerating */
+	bool fRootOrder;	/* moves have been sorted by SortRoot, so enumerate them in order */
+	bool fNextPicked;	/* the next move is already in place at pmveNext, and its hash is in habdNext */
+	HABD habdNext;
+	static const int cmvuQuietMax = 64;
+	MVU amvuQuiet[cmvuQuietMax];	/* quiet moves we've actually searched, for history updates */
+	int cmvuQuiet;
 
 public:
 	inline VMVES(BDG& bdg, PLAI* pplai, int d, GG gg) noexcept;
-	inline void Reset(BDG& bdg) noexcept;
+	inline void Reset(BDG& bdg, int imveFirst = 0) noexcept;
+	void SortRoot(const MVE& mveBest, int imveFirst = 0) noexcept;
+	void MoveMveTo(const MVE& mve, int imveTo) noexcept;
 	inline bool FEnumMvNext(BDG& bdg, MVE*& pmve) noexcept;
 	inline void UndoMv(BDG& bdg) noexcept;
+	__forceinline void SaveSearched(const MVE& mve) noexcept
+	{
+		if (!mve.fIsCapture() && !mve.apcPromote() && cmvuQuiet < cmvuQuietMax)
+			amvuQuiet[cmvuQuiet++] = mve;
+	}
 	bool FOnlyOneMove(MVE& mve) const noexcept;
 
 private:
@@ -272,7 +303,7 @@ enum TS : unsigned {
 	tsNoPruneFutility = 0x0002,
 	tsNoPruneNullPV = 0x0004,
 	tsNoPruneRazoring = 0x0008,
-	tsUNUSED1 = 0x0010,
+	tsNoReduceLMR = 0x0010,
 	tsNoOrderPV = 0x0020,
 	tsNoOrderCapt = 0x0040,
 	tsNoOrderKillers = 0x0080,
@@ -281,6 +312,9 @@ enum TS : unsigned {
 
 	tsNoIterDeepending = 0x0400,
 	tsNoAspiration = 0x0800,
+	tsNoPruneLateMove = 0x1000,
+	tsNoReduceIIR = 0x2000,
+	tsNoPruneProbCut = 0x4000,
 	
 	tsNoTransTable = 0x8000
 };
@@ -313,10 +347,16 @@ public:
 	inline void IncNode(void) noexcept { ++cmveNode; }
 	inline void IncGen(void) noexcept { ++cmveGen; }
 	
-	operator wstring() noexcept { 
-		if (cmveGen == 0)
+	operator wstring() noexcept { return SzRatio(cmveNode, cmveGen); }
+
+	/* effective branching factor, the growth in nodes from the previous
+	   iteration of iterative deepening */
+	wstring SzEbf(const STBF& stbfPrev) const noexcept { return SzRatio(cmveNode, stbfPrev.cmveNode); }
+
+	static wstring SzRatio(unsigned long long wNum, unsigned long long wDen) noexcept {
+		if (wDen == 0)
 			return wstring(L"/0");
-		int w100 = (int)round(100.0 * (double)cmveNode / (double)cmveGen);
+		int w100 = (int)round(100.0 * (double)wNum / (double)wDen);
 		wchar_t sz[12] = L"", * pch = sz;
 		int wInt = w100 / 100;
 		pch = PchDecodeInt(wInt, pch);
@@ -333,11 +373,46 @@ public:
 	inline STBF& operator+=(STBF& stbf) noexcept { return *this; }
 	__forceinline void AddGen(int cmve) noexcept { }
 	__forceinline void AddNode(int cmve) noexcept { }
+	__forceinline void IncNode(void) noexcept { }
+	__forceinline void IncGen(void) noexcept { }
 	__forceinline operator wstring() noexcept { return L""; }
+	__forceinline wstring SzEbf(const STBF& stbfPrev) const noexcept { return L""; }
 #endif
 };
 
 
+/*
+ *
+ *	SS class
+ * 
+ *	Search stack entry. The search keeps one of these for every ply from the 
+ *	root, for the state that's interesting to the nodes above and below it.
+ * 
+ */
+
+
+const int cmvKillers = 2;
+const int cpvMultiMax = 32;	/* maximum number of MultiPV lines */
+
+class SS
+{
+public:
+	EV evStatic;	/* static eval, evInf if we're in check or it wasn't computed */
+	bool fInCheck;
+	bool fImproving;	/* static eval is better than it was 2 plies ago */
+	MV amvKiller[cmvKillers];
+
+	inline void Init(void) noexcept
+	{
+		evStatic = evInf;
+		fInCheck = false;
+		fImproving = true;
+		for (int imv = 0; imv < cmvKillers; imv++)
+			amvKiller[imv] = mvNil;
+	}
+};
+
+
 /*
  *
  *	PLAI class
@@ -367,71 +442,208 @@ protected:
 	/* coefficients this divided by 100 */
 	uint16_t fecoPsqt, fecoMaterial, fecoMobility, fecoKingSafety, fecoPawnStructure, fecoTempo, fecoRandom;
 	const uint16_t fecoScale = 10;
+	EV devProbCut;	/* how far above beta a ProbCut capture must get to cut */
 	mt19937_64 rgen;	/* random number generator */
 	uint64_t habdRand;	/* random number generated at the start of every search used to add randomness
 						   to board eval - which is generated from the Zobrist hash */
 	
 	MVE mveBestOverall;	/* during search, root level best move so far */
+	atomic<bool> fBestOverall;	/* set once mveBestOverall is valid, for time management */
 	DWORD dmsecDeadline, dmsecFlag;
+	DWORD dmsecSoft, dmsecHard;	/* deadline scaled by search stability, and the absolute limit */
+	DWORD dmsecMoveOverhead;	/* time the GUI and protocol take to deliver our move, set by the user */
+	DWORD dmsecLatency;	/* measured time from stopping the search to returning the move */
+	DWORD dmsecOverhead;	/* total time we hold back from the clock on this move */
+	DWORD dmsecStop;	/* when we decided to stop searching */
+	int pctBestChange;	/* decaying count of root best move changes, in percent */
+	int dLimPredict;	/* depth we last predicted the search time of */
+	DWORD dmsecDepthStart, dmsecDepthPrev;	/* start time and duration of the last depth */
+	uint64_t cmveDepthStart, cmveDepthPrev;	/* and its node count */
 	time_point<high_resolution_clock> tpMoveStart;
+	uint64_t cmveLimit;	/* node budget for constant nodes searches, 0 to use the level */
+	int dLimit;			/* depth for constant depth searches, 0 to use the level */
+	uint64_t cmveDeadline;
+	uint64_t cmveMove;	/* nodes this thread has searched on this move; unlike the stats, this
+						   is always counted, because node budgets depend on it */
+	atomic<bool> fPonder;	/* searching on the opponent's time, so no time management */
+	atomic<DWORD> dmsecPonder;	/* time spent pondering before the ponder hit */
+	DWORD dmsecPreSearch;	/* time already spent on this move before the search started */
 	
-	XT xt;
-	static const int cmvKillers = 2;
-	MV amvKillers[256][cmvKillers];
+	XT xtOwn;	/* only used by the main search thread */
+	XT& xt;		/* the transposition table, which is shared by all search threads */
+	uint32_t cbXt;	/* size of the transposition table, in bytes */
+	EVC evc;	/* static eval cache */
+	SS ass[dMax];	/* the search stack, indexed by ply from the root */
 	int mppcsqcHistory[pcMax][sqMax];
+	MV mppcsqmvCounter[pcMax][sqMax];	/* counter moves, indexed by the previous move's piece and destination */
+	/* continuation history, indexed by the piece and destination of the move 1 or 2 
+	   plies back, and then by the piece and destination of the move */
+	static const int chistContMax = 16384;
+	int16_t mpcplypcsqpcsqhistCont[2][pcMax][sqMax][pcMax][sqMax];
+
+	/* triangular principal variation table; amvPV[d] is the PV from depth d, 
+	   which is built as alpha is raised */
+	MV amvPV[dMax][dMax];
+	int acmvPV[dMax];
+	MV amvPVRoot[dMax];	/* PV of the last completed iteration */
+	int cmvPVRoot;
+
+	/* MultiPV analysis, which finds the best cpvMulti lines at the root; the 
+	   lines of the last completed iteration, best first, including the first 
+	   line, which is also in amvPVRoot */
+	int cpvMulti;
+	int cpvMultiCur;
+	MVE amveMulti[cpvMultiMax];
+	MV amvPVMulti[cpvMultiMax][dMax];
+	int acmvPVMulti[cpvMultiMax];
+	int dPvMulti;	/* depth of the lines above */
+	/* lines of the iteration in progress, which only replace the lines above 
+	   once all of them are done */
+	MVE amveMultiNext[cpvMultiMax];
+	MV amvPVMultiNext[cpvMultiMax][dMax];
+	int acmvPVMultiNext[cpvMultiMax];
+	int imveRoot;	/* game move index of the root of the search */
+	uint64_t mpsqsqapccmveRoot[sqMax][sqMax][apcMax];	/* nodes searched under each root move this iteration, 
+														   by from and to square and promotion */
+	__forceinline uint64_t& CmveRoot(const MVE& mve) noexcept { return mpsqsqapccmveRoot[mve.sqFrom()][mve.sqTo()][mve.apcPromote()]; }
 
-	uint16_t cYield;
 	int level;
-	SINT sint;
+	atomic<SINT> sint;	/* interrupt, set by time management or asynchronously by the UI thread */
 	TTM ttm;
+	int cmveCheck;	/* nodes left before we check time management again */
+	int lgcmveCheck;	/* log2 of the number of nodes between time management checks */
+	time_point<high_resolution_clock> tpCheck;	/* time of the last time management check */
+
+	/* the search runs on its own thread; a ponder search waits on this for the 
+	   ponder hit */
+	mutex mtxSearch;
+	condition_variable cvSearch;
+
+	/* multithreaded search; helpers are extra AIs that share our transposition
+	   table and search the same position, but they do no logging or UI */
+	bool fHelper;
+	bool fLog;	/* off for helpers and batch searches, which run many at a time */
+	int cthd;	/* number of search threads, including our own */
+	vector<PLAI*> vpplaiHelper;
+	vector<thread> vthdHelper;
 
 	/* logging statistics */
 
 	STBF stbfMain;	/* stats for main search, but not quiescent */
+	STBF stbfMainPrev;	/* stbfMain from the previous iteration, for effective branch factor */
 	STBF stbfMainAndQ;	/* stats for main + quiescent */
 	STBF stbfMainTotal;	/* cummulative all stats for iterative deepening */
 	STBF stbfMainAndQTotal;	/* cummulative all stats for iterative deepening */
 	int dSel;	/* seldepth for the search */
+#ifndef NOSTATS
+	uint64_t cmvLmr, cmvLmrResearch;	/* late move reductions and their re-searches */
+	uint64_t cmvPruneMoveCount, cmvPruneFutility;	/* late moves pruned */
+	uint64_t cmvCut, cmvCutFirst;	/* beta cut-offs, and those that happened on the first move */
+	uint64_t cbdIir;	/* nodes reduced by internal iterative reduction */
+	uint64_t cbdProbCut;	/* nodes pruned by ProbCut */
+	uint64_t cbdNullVerify, cbdNullVerifyFail;	/* null move verification searches, and those that failed */
+	uint64_t cTimeMan, dnsecTimeMan;	/* time management checks, and the time spent in them */
+	XTS xts;	/* transposition table stats for the game, from all search threads */
+#endif
 
 public:
 	PLAI(GA& ga);
+protected:
+	PLAI(PLAI& plaiMain);
+public:
+	virtual ~PLAI(void);
 	virtual bool FHasLevel(void) const noexcept;
 	virtual void SetLevel(int level) noexcept;
 	virtual int Level(void) const noexcept { return level; }
 	virtual void SetFecoRandom(uint16_t fecoRandom) noexcept { this->fecoRandom = fecoRandom; }
 	virtual void SetTtm(TTM ttm) noexcept;
+	virtual void SetCmveLimit(uint64_t cmveLimit) noexcept;
+	virtual void SetDLimit(int dLimit) noexcept;
+	virtual void SetDmsecMoveOverhead(DWORD dmsecMoveOverhead) noexcept;
+	virtual void SetCpvMulti(int cpvMulti) noexcept;
+	virtual void SetDevProbCut(EV devProbCut) noexcept;
+	virtual int Cthd(void) const noexcept { return cthd; }
+	virtual void SetCthd(int cthd) noexcept;
+	virtual uint64_t CmveSearched(void) const noexcept;
+	void EnableLog(bool fLog) noexcept { this->fLog = fLog; }
+	void SetCbXt(uint32_t cbXt) noexcept { this->cbXt = cbXt; }
+
+	virtual void SetPonder(bool fPonder) noexcept;
+	virtual void PonderHit(void) noexcept;
+	virtual void StopSearch(void) noexcept;
+	virtual MV MvPonder(void) const noexcept;
 	
 	virtual void StartGame(void);
-	void PumpMsg(bool fForce) noexcept;
+
+	virtual bool FHasXt(void) const noexcept { return true; }
+	virtual void SaveXtFile(const wstring& szFile);
+	virtual void LoadXtFile(const wstring& szFile);
 
 	/* search */
 
 public:
 	virtual MVE MveGetNext(SPMV& spmv) noexcept;
+	MVE MveAnalyze(vector<MV>& vmvPV) noexcept;
 protected:
+	void WaitSearch(thread& thdSearch) noexcept;
+	void WaitPonder(void) noexcept;
+	MVE MveSearch(void) noexcept;
 	EV EvBdgSearch(BDG& bdg, const MVE& mvePrev, AB ab, int d, int dLim, TS ts) noexcept;
 	EV EvBdgQuiescent(BDG& bdg, const MVE& mvePrev, AB ab, int d, TS ts) noexcept; 
-	inline bool FSearchMveBest(BDG& bdg, VMVES& vmves, MVE& mveBest, AB ab, int d, int& dLim, TS ts) noexcept;
-	inline bool FPrune(BDG& bdg, MVE& mve, MVE& mveBest, AB& ab, int d, int& dLim) noexcept;
+	inline bool FSearchMveBest(BDG& bdg, VMVES& vmves, MVE& mveBest, AB ab, int d, int& dLim, 
+							   bool fInCheck, EV evStatic, TS ts) noexcept;
+	inline bool FPruneLateMove(BDG& bdg, const MVE& mve, int cmv, const MVE& mveBest, EV evStatic, 
+							   AB ab, int d, int dLim, bool fInCheck, TS ts) noexcept;
+	inline bool FReduceIir(BDG& bdg, int d, int dLim, TS ts) noexcept;
+	inline int DReduceLmr(BDG& bdg, const MVE& mve, int cmv, int d, int dLim, bool fInCheck, TS ts) noexcept;
+	inline bool FPrune(BDG& bdg, MVE& mve, MVE& mveBest, AB& ab, int d, int& dLim, bool fQuiescent = false) noexcept;
 	inline bool FDeepen(BDG& bdg, MVE mveBest, AB& ab, int& d) noexcept;
 	inline bool FLookupXt(BDG& bdg, MVE& mveBest, AB ab, int d, int dLim) noexcept;
-	inline XEV* SaveXt(BDG& bdg, MVE mveBest, AB ab, int d, int dLim) noexcept;
-	inline void SaveKiller(BDG& bdg, MVE mve) noexcept;
+	inline void SaveXt(BDG& bdg, MVE mveBest, AB ab, int d, int dLim, EV evStatic) noexcept;
+	inline EV EvBdgStaticXt(BDG& bdg, const MVE& mvePrev) noexcept;
+	inline void SaveKiller(BDG& bdg, MVE mve, int d) noexcept;
+	inline void InitSs(bool fInCheck) noexcept;
+	inline bool FImproving(int d) const noexcept;
+	inline void SaveCutoff(BDG& bdg, VMVES& vmves, const MVE& mveCut, int d, int dLim) noexcept;
+	inline int16_t* PhistCont(const BDG& bdg, int cply, const MVU& mvu) noexcept;
+	inline void AddHistoryCont(int16_t* phist, int dhist) noexcept;
+	inline void SavePv(int d, const MVE& mve) noexcept;
+	inline void InitRootNodes(void) noexcept;
+	inline MV MvPvFollow(const BDG& bdg, int d) const noexcept;
 	inline void InitHistory(void) noexcept;
 	inline void AddHistory(BDG& bdg, MVE mve, int d, int dLim) noexcept;
 	inline void SubtractHistory(BDG& bdg, MVE mve) noexcept;
 	inline void AgeHistory(void) noexcept;
 	inline bool FTryStaticNullMove(BDG& bdg, MVE& mveBest, EV evStatic, AB ab, int d, int dLim, TS ts) noexcept;
-	inline bool FTryNullMove(BDG& bdg, MVE& mveBest, AB ab, int d, int dLim, TS ts) noexcept;
+	inline bool FTryNullMove(BDG& bdg, MVE& mveBest, EV evStatic, AB ab, int d, int dLim, TS ts) noexcept;
 	inline bool FTryRazoring(BDG& bdg, MVE& mveBest, EV evStatic, AB ab, int d, int dLim, TS ts) noexcept;
+	inline bool FTryProbCut(BDG& bdg, MVE& mveBest, AB ab, int d, int dLim, TS ts) noexcept;
 	inline bool FTryFutility(BDG& bdg, MVE& mveBest, EV evStatic, AB ab, int d, int dLim, TS ts) noexcept;
 	inline bool FTestForDraws(BDG& bdg, MVE& mve) noexcept;
 
+	/* multithreaded search */
+
+	void StartHelpers(const BDG& bdg);
+	void StopHelpers(void);
+	virtual PLAI* PplaiHelperNew(void);
+	void SearchHelper(BDG bdg, int ithd) noexcept;
+	bool FSkipDepthHelper(int ithd, int dLim) const noexcept;
+
+	/* MultiPV */
+
+	int CpvSearchMulti(BDG& bdg, VMVES& vmves, const MVE& mveBest, int dLim, bool fInCheck) noexcept;
+
 	/* time management */
 
 	virtual void InitTimeMan(BDG& bdg) noexcept;
 	virtual bool FBeforeDeadline(int dLim) noexcept;
+	void ScaleDeadline(const MVE& mveBest) noexcept;
+	void MeasureLatency(void) noexcept;
+	DWORD DmsecPredictDepth(int dLim, DWORD dmsec) noexcept;
 	SINT SintTimeMan(void) const noexcept;
+	inline void CheckInterrupt(void) noexcept;
+	void CheckTimeMan(void) noexcept;
+	uint64_t CmveMoveSoFar(void) const noexcept;
 	EV EvMaterialTotal(BDG& bdg) const noexcept;
 	EV EvMaterial(BDG& bdg, CPC cpc) const noexcept;
 	DWORD DmsecMoveSoFar(void) const noexcept;
@@ -440,7 +652,8 @@ protected:
 
 	EV ScoreMove(BDG& bdg, MVE mvePrev) noexcept;
 	EV ScoreCapture(BDG& bdg, MVE mve)  noexcept;
-	bool FScoreKiller(BDG& bdg, MVE& mve) noexcept;
+	bool FScoreKiller(BDG& bdg, MVE& mve, int d) noexcept;
+	bool FScoreCounter(BDG& bdg, MVE& mve) noexcept;
 	bool FScoreHistory(BDG& bdg, MVE& mve) noexcept;
 
 	/* static evaluation */
@@ -468,9 +681,9 @@ protected:
 	
 	void StartMoveLog(void);
 	void EndMoveLog(void);
-	void LogInfo(BDG& bdg, EV ev, int d, int dSel);
+	void LogInfo(BDG& bdg, EV ev, int d, int dSel, int ipv = 0);
 	void LogBestMove(BDG& bdg, MVE mveBest, int d, int dSel);
-	void BuildPvSz(BDG& bdg, wstring& sz);
+	void BuildPvSz(wstring& sz, int ipv = 0) const;
 
 };
 
@@ -493,10 +706,37 @@ protected:
 public:
 	PLAI2(GA& ga);
 protected:
+	PLAI2(PLAI2& plaiMain);
+	virtual PLAI* PplaiHelperNew(void);
 	virtual void InitWeightTables(void);
 };
 
 
+/*
+ *
+ *	PLPNS
+ * 
+ *	The regular AI with a proof-number mate solver in front of it. Before each
+ *	move, we spend a slice of our time looking for a forced mate, and only fall
+ *	back on the alpha-beta search when we don't find one.
+ * 
+ */
+
+
+class PLPNS : public PLAI
+{
+	PNS pns;
+
+public:
+	PLPNS(GA& ga);
+
+	virtual MVE MveGetNext(SPMV& spmv) noexcept;
+protected:
+	bool FSolveMate(void);
+	DWORD DmsecMateBudget(void) const noexcept;
+};
+
+
 /*
  *
  *	PLHUMAN player class
@@ -537,6 +777,7 @@ enum CLPL : int 	// player classes
 	clplFirst = 0,
 	clplAI = 0,
 	clplAI2,
+	clplPNS,
 	clplHuman,
 	clplMax
 };
@@ -0,0 +1,294 @@
+/*
+ *
+ *	pns.cpp
+ *
+ *	Proof-number search mate solver. See Allis, "Searching for Solutions in
+ *	Games and Artificial Intelligence" for the algorithm.
+ *
+ */
+
+#include "pns.h"
+
+
+wstring to_wstring(PNSR pnsr)
+{
+	switch (pnsr) {
+	case pnsrProved:
+		return L"Mate found";
+	case pnsrDisproved:
+		return L"No mate";
+	case pnsrOutOfMemory:
+		return L"Out of memory";
+	case pnsrOutOfTime:
+		return L"Out of time";
+	case pnsrCanceled:
+		return L"Canceled";
+	default:
+		assert(false);
+		return L"";
+	}
+}
+
+
+PNS::PNS(void) : cmvMateMax(5), cbMax(64*1024*1024), dmsecMax(0),
+	pnsr(pnsrDisproved), cpnnExpand(0), cpnnUsed(0), dmsecSolve(0), cpnnMax(0)
+{
+}
+
+
+/*	PNS::FSolve
+ *
+ *	Tries to prove the side to move in bdgRoot can force mate within cmvMateMax
+ *	moves. Returns true if it can, with the mate line in vmvMate. The node store
+ *	only lives for the duration of the solve.
+ *
+ *	The basic loop is the standard one: walk from the root down to the most-
+ *	proving node, expand it, and then back the proof and disproof numbers up
+ *	the path we came down. We keep one board and make and undo moves along
+ *	the path, so there's no need to store positions in the nodes.
+ */
+bool PNS::FSolve(const BDG& bdgRoot)
+{
+	tpStart = high_resolution_clock::now();
+	cpnnExpand = 0;
+	vmvMate.clear();
+	cpnnMax = (uint32_t)min(cbMax / sizeof(PNN), (uint64_t)pnInf);
+	vpnn.clear();
+	vpnn.push_back(PNN(mvNil, 1, 1));
+	pnsr = pnsrDisproved;
+
+	BDG bdg = bdgRoot;
+	while (!vpnn[0].FSolved() && !FInterrupt()) {
+
+		/* find the most-proving node */
+		vipnnPath.clear();
+		uint32_t ipnn = 0;
+		int d = 0;
+		while (vpnn[ipnn].FExpanded()) {
+			vipnnPath.push_back(ipnn);
+			ipnn = IpnnMostProving(ipnn, d++);
+			MVE mve = bdg.MveFromMv(vpnn[ipnn].mv);
+			bdg.MakeMv(mve);
+		}
+
+		bool fExpanded = FExpand(bdg, ipnn, d);
+
+		/* and back up the proof numbers, restoring the board as we go */
+		while (!vipnnPath.empty()) {
+			bdg.UndoMv();
+			Update(vipnnPath.back(), --d);
+			vipnnPath.pop_back();
+		}
+
+		if (!fExpanded) {
+			pnsr = pnsrOutOfMemory;
+			break;
+		}
+	}
+
+	if (vpnn[0].pn == 0) {
+		pnsr = pnsrProved;
+		BuildMateLine();
+	}
+	else if (vpnn[0].dn == 0)
+		pnsr = pnsrDisproved;
+	dmsecSolve = (DWORD)duration_cast<milliseconds>(high_resolution_clock::now() - tpStart).count();
+
+	/* give the memory back */
+	cpnnUsed = vpnn.size();
+	vector<PNN>().swap(vpnn);
+	return pnsr == pnsrProved;
+}
+
+
+/*	PNS::FExpand
+ *
+ *	Creates the children of the node ipnn, which is at ply d. The board must be
+ *	positioned at the node. Each child is evaluated immediately: mates and
+ *	draws are solved right away, nodes that are past the mate depth limit are
+ *	disproved, and everything else gets initial proof and disproof numbers
+ *	based on the number of legal replies, so the search prefers lines where
+ *	the defender doesn't have many choices.
+ *
+ *	Returns false if we don't have the memory left to expand the node. The node
+ *	store grows as we need it, up to the memory budget, so easy problems don't 
+ *	pay for the whole budget.
+ */
+bool PNS::FExpand(BDG& bdg, uint32_t ipnn, int d)
+{
+	VMVE vmve;
+	bdg.GenMoves(vmve, ggLegal);
+
+	/* only the root can get here with no moves, every other terminal node is
+	   solved when it's created */
+	if (vmve.cmve() == 0) {
+		assert(ipnn == 0);
+		vpnn[ipnn].pn = pnInf;
+		vpnn[ipnn].dn = 0;
+		return true;
+	}
+	if (vpnn.size() + vmve.cmve() > cpnnMax)
+		return false;
+	if (vpnn.size() + vmve.cmve() > vpnn.capacity())
+		vpnn.reserve(min(max(2 * vpnn.capacity(), vpnn.size() + vmve.cmve() + 4096), (size_t)cpnnMax));
+
+	bool fOr = d % 2 == 0;
+	uint32_t ipnnFirst = (uint32_t)vpnn.size();
+	for (MVE& mve : vmve) {
+		bdg.MakeMv(mve);
+		VMVE vmveReply;
+		bdg.GenMoves(vmveReply, ggLegal);
+		uint32_t pn, dn;
+		if (vmveReply.cmve() == 0) {
+			/* checkmate is a win for whoever just moved; stalemate is a draw, which
+			   is as good as a loss for the attacker */
+			bool fProved = fOr && bdg.FInCheck(bdg.cpcToMove);
+			pn = fProved ? 0 : pnInf;
+			dn = fProved ? pnInf : 0;
+		}
+		else if (d + 1 >= 2 * cmvMateMax - 1 || bdg.GsTestGameOver(vmveReply.cmve(), 2) != gsPlaying) {
+			pn = pnInf;
+			dn = 0;
+		}
+		else if (fOr) {
+			pn = vmveReply.cmve();
+			dn = 1;
+		}
+		else {
+			pn = 1;
+			dn = vmveReply.cmve();
+		}
+		bdg.UndoMv();
+		vpnn.push_back(PNN(mve, pn, dn));
+
+		/* once one child solves the node, there's no point generating the rest */
+		if (fOr ? pn == 0 : dn == 0)
+			break;
+	}
+
+	vpnn[ipnn].ipnnChildFirst = ipnnFirst;
+	vpnn[ipnn].cpnnChild = (uint8_t)(vpnn.size() - ipnnFirst);
+	cpnnExpand++;
+	Update(ipnn, d);
+	return true;
+}
+
+
+/*	PNS::Update
+ *
+ *	Recomputes the proof and disproof numbers of an expanded node from its
+ *	children. An OR node is proved by any child and disproved only by all of
+ *	them; AND nodes are the other way around.
+ */
+void PNS::Update(uint32_t ipnn, int d) noexcept
+{
+	PNN& pnn = vpnn[ipnn];
+	assert(pnn.FExpanded());
+	const PNN* ppnnFirst = &vpnn[pnn.ipnnChildFirst];
+	const PNN* ppnnLim = ppnnFirst + pnn.cpnnChild;
+	if (d % 2 == 0) {
+		pnn.pn = pnInf;
+		pnn.dn = 0;
+		for (const PNN* ppnn = ppnnFirst; ppnn < ppnnLim; ppnn++) {
+			pnn.pn = min(pnn.pn, ppnn->pn);
+			pnn.dn = PnAdd(pnn.dn, ppnn->dn);
+		}
+	}
+	else {
+		pnn.pn = 0;
+		pnn.dn = pnInf;
+		for (const PNN* ppnn = ppnnFirst; ppnn < ppnnLim; ppnn++) {
+			pnn.pn = PnAdd(pnn.pn, ppnn->pn);
+			pnn.dn = min(pnn.dn, ppnn->dn);
+		}
+	}
+}
+
+
+/*	PNS::IpnnMostProving
+ *
+ *	Picks the child of ipnn to follow on the way down to the most-proving node,
+ *	which is the child with the smallest proof number at OR nodes and the
+ *	smallest disproof number at AND nodes.
+ */
+uint32_t PNS::IpnnMostProving(uint32_t ipnn, int d) const noexcept
+{
+	const PNN& pnn = vpnn[ipnn];
+	uint32_t ipnnBest = pnn.ipnnChildFirst;
+	for (uint32_t ipnnChild = ipnnBest + 1; ipnnChild < pnn.ipnnChildFirst + pnn.cpnnChild; ipnnChild++) {
+		if (d % 2 == 0 ? vpnn[ipnnChild].pn < vpnn[ipnnBest].pn : vpnn[ipnnChild].dn < vpnn[ipnnBest].dn)
+			ipnnBest = ipnnChild;
+	}
+	return ipnnBest;
+}
+
+
+/*	PNS::FInterrupt
+ *
+ *	Checks the time limit and the caller's interrupt. Sets the result if we're
+ *	stopping.
+ */
+bool PNS::FInterrupt(void)
+{
+	if (pfnInterrupt && pfnInterrupt()) {
+		pnsr = pnsrCanceled;
+		return true;
+	}
+	if (dmsecMax > 0 &&
+			(DWORD)duration_cast<milliseconds>(high_resolution_clock::now() - tpStart).count() >= dmsecMax) {
+		pnsr = pnsrOutOfTime;
+		return true;
+	}
+	return false;
+}
+
+
+/*	PNS::DMate
+ *
+ *	Number of plies to mate from a proved node, with the attacker taking the
+ *	quickest mate and the defender the slowest. Proof-number search doesn't
+ *	care how long the mate is, so this is the only place we figure that out.
+ */
+int PNS::DMate(uint32_t ipnn, int d) const noexcept
+{
+	const PNN& pnn = vpnn[ipnn];
+	assert(pnn.pn == 0);
+	if (!pnn.FExpanded())
+		return 0;
+	int dMate = d % 2 == 0 ? INT_MAX : 0;
+	for (uint32_t ipnnChild = pnn.ipnnChildFirst; ipnnChild < pnn.ipnnChildFirst + pnn.cpnnChild; ipnnChild++) {
+		if (vpnn[ipnnChild].pn != 0)
+			continue;
+		int dChild = 1 + DMate(ipnnChild, d + 1);
+		dMate = d % 2 == 0 ? min(dMate, dChild) : max(dMate, dChild);
+	}
+	return dMate;
+}
+
+
+/*	PNS::BuildMateLine
+ *
+ *	Pulls the main line of the proof out of the tree, the shortest mate for the
+ *	attacker against the longest defense.
+ */
+void PNS::BuildMateLine(void)
+{
+	uint32_t ipnn = 0;
+	for (int d = 0; vpnn[ipnn].FExpanded(); d++) {
+		const PNN& pnn = vpnn[ipnn];
+		uint32_t ipnnBest = UINT32_MAX;
+		int dBest = 0;
+		for (uint32_t ipnnChild = pnn.ipnnChildFirst; ipnnChild < pnn.ipnnChildFirst + pnn.cpnnChild; ipnnChild++) {
+			if (vpnn[ipnnChild].pn != 0)
+				continue;
+			int dChild = DMate(ipnnChild, d + 1);
+			if (ipnnBest == UINT32_MAX || (d % 2 == 0 ? dChild < dBest : dChild > dBest)) {
+				ipnnBest = ipnnChild;
+				dBest = dChild;
+			}
+		}
+		assert(ipnnBest != UINT32_MAX);
+		vmvMate.push_back(vpnn[ipnnBest].mv);
+		ipnn = ipnnBest;
+	}
+}
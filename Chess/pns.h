@@ -0,0 +1,116 @@
+/*
+ *
+ *	pns.h
+ *
+ *	Proof-number search mate solver. This is a completely separate search from
+ *	the alpha-beta AI. It only answers one question, whether the side to move
+ *	can force checkmate within a given number of moves, and it's much better at
+ *	answering that than alpha-beta is, because it naturally goes after the
+ *	lines where the defender has the fewest replies.
+ *
+ */
+#pragma once
+#include "bd.h"
+#include <functional>
+
+
+/*
+ *
+ *	PNN - proof-number tree node
+ *
+ *	Nodes are kept in one big array, and the children of a node are always
+ *	allocated contiguously, so we only need the index of the first one. We
+ *	don't keep parent links; the path from the root is tracked during the
+ *	search instead. Nodes are kept small because the memory budget is what
+ *	limits how big a problem we can solve.
+ *
+ *	Nodes at even plies are OR nodes (attacker to move), nodes at odd plies
+ *	are AND nodes (defender to move).
+ *
+ */
+
+
+const uint32_t pnInf = 0x7fffffff;	/* proof/disproof number of a solved node */
+
+inline uint32_t PnAdd(uint32_t pn1, uint32_t pn2) noexcept
+{
+	return min(pn1 + pn2, pnInf);
+}
+
+struct PNN
+{
+	uint32_t pn;		/* proof number, 0 if proved */
+	uint32_t dn;		/* disproof number, 0 if disproved */
+	uint32_t ipnnChildFirst;
+	MV mv;				/* the move that got us to this node */
+	uint8_t cpnnChild;	/* 0 if not expanded yet */
+
+	PNN(MV mv, uint32_t pn, uint32_t dn) noexcept :
+		pn(pn), dn(dn), ipnnChildFirst(0), mv(mv), cpnnChild(0)
+	{
+	}
+
+	bool FExpanded(void) const noexcept { return cpnnChild > 0; }
+	bool FSolved(void) const noexcept { return pn == 0 || dn == 0; }
+};
+
+
+/*
+ *
+ *	PNS - proof-number searcher
+ *
+ *	Set the limits, call FSolve, and if it returns true, the mate line is in
+ *	vmvMate. If it returns false, the position was either disproved (no mate
+ *	within the limit) or we ran out of time or memory, which is reported in
+ *	pnsr.
+ *
+ */
+
+
+enum PNSR	// proof-number search results
+{
+	pnsrProved,
+	pnsrDisproved,
+	pnsrOutOfMemory,
+	pnsrOutOfTime,
+	pnsrCanceled
+};
+
+wstring to_wstring(PNSR pnsr);
+
+
+class PNS
+{
+public:
+	/* limits */
+	int cmvMateMax;			/* look for mates in this many moves or fewer */
+	uint64_t cbMax;			/* memory budget for the node store */
+	DWORD dmsecMax;			/* time limit, 0 for no limit */
+	function<bool(void)> pfnInterrupt;	/* optional async interrupt check */
+
+	/* results */
+	PNSR pnsr;
+	vector<MV> vmvMate;		/* the mate line, attacker's move first */
+	uint64_t cpnnExpand;
+	size_t cpnnUsed;		/* size of the node store when we stopped */
+	DWORD dmsecSolve;
+
+private:
+	vector<PNN> vpnn;
+	vector<uint32_t> vipnnPath;	/* path from the root to the node being worked on */
+	uint32_t cpnnMax;
+	time_point<high_resolution_clock> tpStart;
+
+public:
+	PNS(void);
+
+	bool FSolve(const BDG& bdgRoot);
+
+private:
+	bool FExpand(BDG& bdg, uint32_t ipnn, int d);
+	void Update(uint32_t ipnn, int d) noexcept;
+	uint32_t IpnnMostProving(uint32_t ipnn, int d) const noexcept;
+	bool FInterrupt(void);
+	int DMate(uint32_t ipnn, int d) const noexcept;
+	void BuildMateLine(void);
+};
@@ -90,11 +90,68 @@ APC UCI::ApcParse(const char*& sz)
 }
 
 
+/*	UCI::Go
+ *
+ *	Starts a search on the current position. The search runs on its own thread,
+ *	and writes out the best move when it's done, so the console pump keeps on 
+ *	reading commands while the engine thinks. We only ponder if the GUI has 
+ *	turned on the Ponder option; otherwise go ponder is a normal search.
+ */
 void UCI::Go(const GO& go)
 {
-	SPMV spmv;
-	MVE mve = puiga->ga.PplToMove()->MveGetNext(spmv);
-	WriteSz(string("bestmove ") + SzDecodeMv(mve));
+	WaitGo();
+
+	PL* ppl = pplGo = puiga->ga.PplToMove();
+	ppl->SetTtm(go.ttm);
+	ppl->SetCmveLimit(go.ttm == ttmConstNodes ? go.cmveSearch : 0);
+	ppl->SetDLimit(go.ttm == ttmConstDepth ? go.dSearch : 0);
+	ppl->SetPonder(go.fPonder && fPonderOption);
+
+	thdGo = thread([this, ppl]() {
+		SPMV spmv;
+		MVE mve = ppl->MveGetNext(spmv);
+		string sz = string("bestmove ") + SzDecodeMv(mve);
+		MV mvPonder = ppl->MvPonder();
+		if (!mve.fIsNil() && !mvPonder.fIsNil())
+			sz += string(" ponder ") + SzDecodeMv(mvPonder);
+		WriteSz(sz);
+	});
+}
+
+
+/*	UCI::Stop
+ *
+ *	Stops the search in progress, which will write out the best move it has 
+ *	found so far. If we were pondering, this is a ponder miss.
+ */
+void UCI::Stop(void)
+{
+	if (thdGo.joinable())
+		pplGo->StopSearch();
+	WaitGo();
+}
+
+
+/*	UCI::PonderHit
+ *
+ *	The opponent made the move we were pondering on, so the ponder search turns
+ *	into a normal search.
+ */
+void UCI::PonderHit(void)
+{
+	if (thdGo.joinable())
+		pplGo->PonderHit();
+}
+
+
+/*	UCI::WaitGo
+ *
+ *	Waits for the search thread to finish.
+ */
+void UCI::WaitGo(void)
+{
+	if (thdGo.joinable())
+		thdGo.join();
 }
 
 
@@ -130,6 +187,7 @@ int UCI::ConsolePump(void)
 			if (FParseAndDispatch(szLine.c_str()))
 				break;
 		}
+		lock_guard<recursive_mutex> lock(papp->mtxUI);
 		puiga->PumpMsg();
 	}
 	return 0;
@@ -154,6 +212,11 @@ int WNextInt(const char*& sz)
 	return atoi(SzNextWord(sz).c_str());
 }
 
+uint64_t CNextUint64(const char*& sz)
+{
+	return strtoull(SzNextWord(sz).c_str(), nullptr, 10);
+}
+
 bool UCI::FParseAndDispatch(const char* sz)
 {
 	/* find keyword */
@@ -171,6 +234,7 @@ bool UCI::FParseAndDispatch(const char* sz)
 
 void UCI::WriteSz(const string& sz)
 {
+	lock_guard<recursive_mutex> lock(papp->mtxUI);
 	DWORD cb;
 	string nsz = sz + "\n";
 	::WriteFile(hfileStdout, nsz.c_str(), (DWORD)nsz.length(), &cb, NULL);
@@ -233,6 +297,11 @@ public:
 	{
 		uci.WriteSz("id name SQ Chess 0.1.20221110");
 		uci.WriteSz("id author Rick Powell");
+		uci.WriteSz("option name Threads type spin default 1 min 1 max 32");
+		uci.WriteSz("option name Ponder type check default false");
+		uci.WriteSz("option name Move Overhead type spin default 30 min 0 max 5000");
+		uci.WriteSz("option name MultiPV type spin default 1 min 1 max 32");
+		uci.WriteSz("option name ProbCut Margin type spin default 200 min 0 max 1000");
 		uci.WriteSz("uciok");
 		return 1;
 	}
@@ -276,6 +345,39 @@ public:
 
 	virtual int Execute(string szArg)
 	{
+		const char* sz = szArg.c_str();
+		if (SzNextWord(sz) != "name")
+			return 1;
+		/* option names can have spaces in them */
+		string szName = SzNextWord(sz);
+		for (string szWord = SzNextWord(sz); szWord != "value"; szWord = SzNextWord(sz)) {
+			if (szWord.empty())
+				return 1;
+			szName += " " + szWord;
+		}
+		if (szName == "Threads") {
+			int cthd = WNextInt(sz);
+			for (CPC cpc = cpcWhite; cpc < cpcMax; ++cpc)
+				uci.puiga->ga.PplFromCpc(cpc)->SetCthd(cthd);
+		}
+		else if (szName == "Ponder") {
+			uci.fPonderOption = SzNextWord(sz) == "true";
+		}
+		else if (szName == "MultiPV") {
+			int cpv = WNextInt(sz);
+			for (CPC cpc = cpcWhite; cpc < cpcMax; ++cpc)
+				uci.puiga->ga.PplFromCpc(cpc)->SetCpvMulti(cpv);
+		}
+		else if (szName == "Move Overhead") {
+			int dmsec = WNextInt(sz);
+			for (CPC cpc = cpcWhite; cpc < cpcMax; ++cpc)
+				uci.puiga->ga.PplFromCpc(cpc)->SetDmsecMoveOverhead(max(dmsec, 0));
+		}
+		else if (szName == "ProbCut Margin") {
+			int dev = WNextInt(sz);
+			for (CPC cpc = cpcWhite; cpc < cpcMax; ++cpc)
+				uci.puiga->ga.PplFromCpc(cpc)->SetDevProbCut((EV)clamp(dev, 0, 10*evPawn));
+		}
 		return 1;
 	}
 };
@@ -335,6 +437,7 @@ public:
 	{
 		GO go;
 		go.ttm = ttmSmart;
+		go.fPonder = false;
 		go.mpcpcdtm[cpcWhite] = 5 * 60 * 1000;
 		go.mpcpcdtm[cpcBlack] = 5 * 60 * 1000;
 		go.mpcpcdtmInc[cpcWhite] = 1000;
@@ -345,6 +448,7 @@ public:
 			if (szCmd == "searchmoves") {
 			}
 			else if (szCmd == "ponder") {
+				go.fPonder = true;
 			}
 			else if (szCmd == "wtime") {
 				go.ttm = ttmSmart;
@@ -368,7 +472,7 @@ public:
 			}
 			else if (szCmd == "nodes") {
 				go.ttm = ttmConstNodes;
-				go.cmveSearch = WNextInt(sz);
+				go.cmveSearch = CNextUint64(sz);
 			}
 			else if (szCmd == "mate") {
 			}
@@ -394,6 +498,7 @@ public:
 
 	virtual int Execute(string szArg)
 	{
+		uci.Stop();
 		return 1;
 	}
 };
@@ -405,6 +510,7 @@ public:
 
 	virtual int Execute(string szArg)
 	{
+		uci.PonderHit();
 		return 1;
 	}
 };
@@ -416,12 +522,13 @@ public:
 
 	virtual int Execute(string szArg)
 	{
+		uci.Stop();
 		return 0;
 	}
 };
 
 
-UCI::UCI(UIGA* puiga) : puiga(puiga), hfileStdin(NULL), hfileStdout(NULL)
+UCI::UCI(UIGA* puiga) : puiga(puiga), hfileStdin(NULL), hfileStdout(NULL), pplGo(nullptr), fPonderOption(false)
 {
 	/* set up stdin/out */
 
@@ -453,6 +560,7 @@ UCI::UCI(UIGA* puiga) : puiga(puiga), hfileStdin(NULL), hfileStdout(NULL)
 
 UCI::~UCI(void)
 {
+	Stop();
 	if (!fInherited)
 		::FreeConsole();
 }
@@ -19,12 +19,13 @@
 
 struct GO
 {
-	int cmveSearch;
+	uint64_t cmveSearch;
 	int dSearch;
 	int mpcpcdtm[cpcMax];
 	int mpcpcdtmInc[cpcMax];
 	int dtmSearch;
 	TTM ttm;
+	bool fPonder;
 };
 
 
@@ -49,6 +50,9 @@ public:
 	bool fInherited, fStdinPipe;
 	HANDLE hfileStdin, hfileStdout;
 	map<string, CMDU*> mpszpcmdu;
+	thread thdGo;	/* searches run on their own thread so we can still read stop and ponderhit */
+	PL* pplGo;
+	bool fPonderOption;	/* the GUI turned on the Ponder option */
 public:
 	UCI(UIGA* puiga);
 	~UCI(void);
@@ -69,6 +73,9 @@ public:
 	string SzDecodeSq(SQ sq);
 
 	void Go(const GO& go);
+	void Stop(void);
+	void PonderHit(void);
+	void WaitGo(void);
 };
 
 
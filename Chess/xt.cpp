@@ -0,0 +1,132 @@
+/*
+ *
+ *	xt.cpp
+ *
+ *	Transposition table persistence. The table itself is all inline in xt.h
+ *	because it's so speed critical; this is the slow stuff that only happens
+ *	when the user asks for it.
+ *
+ */
+
+#include "xt.h"
+
+
+/*
+ *
+ *	MAPF
+ *
+ *	Little wrapper around a memory-mapped file, so the handles get cleaned
+ *	up on the error paths.
+ *
+ */
+
+
+class MAPF
+{
+	HANDLE hfile;
+	HANDLE hmap;
+public:
+	uint8_t* pb;
+	uint64_t cb;	/* size of the mapped file */
+
+	MAPF(void) : hfile(INVALID_HANDLE_VALUE), hmap(NULL), pb(nullptr), cb(0) { }
+
+	~MAPF(void)
+	{
+		if (pb)
+			::UnmapViewOfFile(pb);
+		if (hmap)
+			::CloseHandle(hmap);
+		if (hfile != INVALID_HANDLE_VALUE)
+			::CloseHandle(hfile);
+	}
+
+	void Open(const wstring& szFile, bool fWrite, uint64_t cbWrite)
+	{
+		cb = cbWrite;
+		hfile = ::CreateFileW(szFile.c_str(), fWrite ? GENERIC_READ|GENERIC_WRITE : GENERIC_READ,
+							  fWrite ? 0 : FILE_SHARE_READ, NULL,
+							  fWrite ? CREATE_ALWAYS : OPEN_EXISTING,
+							  FILE_ATTRIBUTE_NORMAL|FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (hfile == INVALID_HANDLE_VALUE)
+			throw EX("Unable to open transposition table file");
+		if (!fWrite) {
+			LARGE_INTEGER li;
+			if (!::GetFileSizeEx(hfile, &li) || li.QuadPart < sizeof(XTH))
+				throw EX("Transposition table file is corrupt");
+			cb = li.QuadPart;
+		}
+		hmap = ::CreateFileMappingW(hfile, NULL, fWrite ? PAGE_READWRITE : PAGE_READONLY,
+									(DWORD)(cb >> 32), (DWORD)cb, NULL);
+		if (hmap == NULL)
+			throw EX("Unable to map transposition table file");
+		pb = (uint8_t*)::MapViewOfFile(hmap, fWrite ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+		if (pb == nullptr)
+			throw EX("Unable to map transposition table file");
+	}
+};
+
+
+/*	XT::SaveFile
+ *
+ *	Dumps the entire transposition table, including the current age, to the
+ *	given file. Throws an exception on failure.
+ */
+void XT::SaveFile(const wstring& szFile) const
+{
+	if (axev2 == nullptr)
+		throw EX("Transposition table is empty");
+
+	uint64_t cbTable = (uint64_t)cxev2Max * sizeof(XEV2);
+	MAPF mapf;
+	mapf.Open(szFile, true, sizeof(XTH) + cbTable);
+
+	XTH* pxth = (XTH*)mapf.pb;
+	memset(pxth, 0, sizeof(XTH));
+	pxth->sig = sigXtFile;
+	pxth->ver = verXev;
+	pxth->cbXev2 = sizeof(XEV2);
+	pxth->cxev2Max = cxev2Max;
+	pxth->habdSig = genhabd.HabdSignature();
+	pxth->age = age;
+	memcpy(mapf.pb + sizeof(XTH), axev2, cbTable);
+}
+
+
+/*	XT::LoadFile
+ *
+ *	Reloads a transposition table previously saved with SaveFile. The file must
+ *	have been saved with the same entry format, table size, and hash keys as
+ *	the running table, otherwise we throw an exception and leave the table
+ *	untouched.
+ *
+ *	The file is memory mapped, so we're only limited by disk read speed.
+ */
+void XT::LoadFile(const wstring& szFile)
+{
+	MAPF mapf;
+	mapf.Open(szFile, false, 0);
+
+	const XTH* pxth = (const XTH*)mapf.pb;
+	if (pxth->sig != sigXtFile)
+		throw EX("Not a transposition table file");
+	if (pxth->ver != verXev || pxth->cbXev2 != sizeof(XEV2))
+		throw EX("Transposition table file is from an incompatible version");
+	if (pxth->habdSig != genhabd.HabdSignature())
+		throw EX("Transposition table file uses different hash keys");
+	if (pxth->age >= ageMax)
+		throw EX("Transposition table file is corrupt");
+	if (axev2 == nullptr)
+		throw EX("Transposition table has not been initialized");
+	if (pxth->cxev2Max != cxev2Max)
+		throw EX("Transposition table file is a different size than the current table");
+	if (mapf.cb != sizeof(XTH) + (uint64_t)cxev2Max * sizeof(XEV2))
+		throw EX("Transposition table file is corrupt");
+
+	memcpy(axev2, mapf.pb + sizeof(XTH), (uint64_t)cxev2Max * sizeof(XEV2));
+	age = pxth->age;
+
+#ifndef NOSTATS
+	ClearStats();
+#endif
+}
@@ -49,30 +49,40 @@ __forceinline bool operator<(TEV tev1, TEV tev2) noexcept { return crunch(tev1)
  *	table, so we need to keep the hash itself in the structure to verify the
  *	match.
  * 
+ *	Everything but the hash is packed into one 64-bit data word, and the hash
+ *	is stored xor'ed with the data word, so the full 64-bit hash is checked 
+ *	against the whole entry, including the static eval. An entry that was 
+ *	half-written by another search thread won't match anything.
+ * 
  */
 
-#pragma pack(push, 1)
 class XEV
 {
 private:
-	uint32_t 
-		uhabdLow:16,
-		umv:16;			
-	uint32_t
-		udd : 7,		/* word-aligned */
-		ufVisited : 1,
-		utev : 2,		/* word-aligned */
-		uage : 2,
-		unused1 : 4,
-		uevBiased : 15, /* word-aligned */
-		unused2 : 1;
+#pragma warning(suppress:4201)	// nameless struct/union
+	union {
+		struct {
+			uint64_t
+				umv : 16,
+				udd : 7,
+				ufVisited : 1,
+				utev : 2,
+				uage : 2,
+				unused1 : 4,
+				uevBiased : 15,
+				unused2 : 1,
+				uevStaticBiased : 16;	/* zero if we don't have a static eval */
+		};
+		uint64_t udata;
+	};
+	uint64_t habdCheck;	/* board hash xor the data word */
 public:
 
 	/* most of this crap is just here to cast bit fields to the correct type  */
 
 #pragma warning(suppress:26495)	// don't warn about uninitialized member variables 
 	__forceinline XEV(void) { SetNull(); }
-	__forceinline XEV(HABD habd, MVU mvu, TEV tev, EV ev, int d, int dLim) { Save(habd, ev, tev, d, dLim, mvu, 0); }
+	__forceinline XEV(HABD habd, MVU mvu, TEV tev, EV ev, int d, int dLim) { Save(habd, ev, tev, d, dLim, mvu, 0, evInf); }
 	__forceinline void SetNull(void) noexcept { memset(this, 0, sizeof(XEV)); }
 
 	/* store ev biased so we can get the sign extended on extraction; mate evals
@@ -100,6 +110,17 @@ public:
 		uevBiased = static_cast<uint16_t>(ev + evBias); 
 	}
 	
+	/* static eval of the board, which doesn't depend on the depth of the search,
+	   so it's useful even when the rest of the entry isn't. evInf means the
+	   static eval wasn't saved (which happens with nodes in check) */
+	__forceinline bool FHasEvStatic(void) const noexcept { return uevStaticBiased != 0; }
+	__forceinline EV evStatic(void) const noexcept { return static_cast<EV>(uevStaticBiased) - evBias; }
+	__forceinline void SetEvStatic(EV ev) noexcept
+	{
+		assert(ev <= evInf && ev > -evInf);
+		uevStaticBiased = ev == evInf ? 0 : static_cast<uint16_t>(ev + evBias);
+	}
+
 	/* eval type, equal, less, or greater; null for unused entries */
 	__forceinline TEV tev(void) const noexcept { return static_cast<TEV>(utev); }
 	__forceinline void SetTev(TEV tev) noexcept { utev = static_cast<unsigned>(tev); }
@@ -108,10 +129,11 @@ public:
 	__forceinline int dd(void) const noexcept { return static_cast<int>(udd); }
 	__forceinline void SetDd(int dd) noexcept { udd = (unsigned)dd; }
 	
-	/* hash match; this is not exact, but the high bits are used to index into the table, 
-	   and this test makes sure the low bits match */
-	__forceinline bool FMatchHabd(HABD habd) const noexcept { return uhabdLow == (uint16_t)habd; }
-	__forceinline void SetHabd(HABD habd) noexcept { uhabdLow = (uint16_t)habd; }
+	/* hash match, which checks the entire hash against the entire entry. Since
+	   the check depends on the data, SetHabd must be called after any other
+	   field changes */
+	__forceinline bool FMatchHabd(HABD habd) const noexcept { return (habdCheck ^ udata) == habd; }
+	__forceinline void SetHabd(HABD habd) noexcept { habdCheck = habd ^ udata; }
 	
 	/* for tevEqual entries, the best move from this position. For higher than
 	   entries, it'll be the move that caused the cut; for lower, I think it might
@@ -127,17 +149,17 @@ public:
 	__forceinline bool fVisited(void) const noexcept { return ufVisited; }
 	__forceinline void SetFVisited(bool fVisitedNew) noexcept { this->ufVisited = static_cast<unsigned>(fVisitedNew); }
 	
-	void Save(HABD habd, EV ev, TEV tev, int d, int dLim, MV mv, unsigned age) noexcept 
+	void Save(HABD habd, EV ev, TEV tev, int d, int dLim, MV mv, unsigned age, EV evStatic) noexcept 
 	{
-		SetHabd(habd);
 		SetEv(ev, d);
+		SetEvStatic(evStatic);
 		SetTev(tev);
 		SetDd(dLim - d);
 		SetMv(mv);
 		SetAge(age);
+		SetHabd(habd);
 	}
 };
-#pragma pack(pop)
 
 
 /*
@@ -145,13 +167,14 @@ public:
  *	XEV2
  * 
  *	Our cache map uses a 2-strategy entry for each hash index. We keep both
- *	the deepest node found during the search, and the newest. 
+ *	the deepest node found during the search, and the newest. Entries are 
+ *	aligned so two of them fit exactly in a cache line, which means one 
+ *	prefetch brings in everything a probe looks at.
  * 
  */
 
 
-#pragma pack(push, 1)
-__declspec(align(2)) struct XEV2 {
+__declspec(align(32)) struct XEV2 {
 	XEV xevDeep;
 	XEV xevNew;
 
@@ -176,7 +199,69 @@ __declspec(align(2)) struct XEV2 {
 			VirtualFree(p, 0, MEM_RELEASE);
 	}
 };
-#pragma pack(pop)
+
+static_assert(sizeof(XEV2) == 32, "transposition table entries must divide a cache line");
+
+
+/*
+ *
+ *	XTH
+ * 
+ *	Header of a saved transposition table file. The file is just this header
+ *	followed by the raw XEV2 array. Anything in the header that doesn't match
+ *	the running table means the file is stale or from an incompatible build, 
+ *	and we refuse to load it.
+ * 
+ */
+
+
+const uint32_t sigXtFile = 0x54585153;	/* "SQXT" */
+const uint32_t verXev = 3;	/* bump whenever the XEV layout changes */
+
+struct XTH {
+	uint32_t sig;
+	uint32_t ver;
+	uint32_t cbXev2;	/* size of a single table entry */
+	uint32_t cxev2Max;	/* number of entries in the table */
+	HABD habdSig;		/* signature of the Zobrist keys the entries were hashed with */
+	uint32_t age;
+	uint32_t unused;
+};
+
+
+/*
+ *
+ *	XTS
+ * 
+ *	Transposition table stats, which are kept per search thread.
+ * 
+ */
+
+
+#ifndef NOSTATS
+struct XTS {
+	uint64_t cxevProbe, cxevProbeHit;
+	uint64_t cxevSave, cxevSaveCollision, cxevSaveReplace;
+	uint64_t cxevProbeEvStatic, cxevProbeEvStaticHit;
+
+	XTS(void) noexcept { Clear(); }
+
+	void Clear(void) noexcept
+	{
+		cxevProbe = cxevProbeHit = 0;
+		cxevSave = cxevSaveCollision = cxevSaveReplace = 0;
+		cxevProbeEvStatic = cxevProbeEvStaticHit = 0;
+	}
+
+	XTS& operator+=(const XTS& xts) noexcept
+	{
+		cxevProbe += xts.cxevProbe; cxevProbeHit += xts.cxevProbeHit;
+		cxevSave += xts.cxevSave; cxevSaveCollision += xts.cxevSaveCollision; cxevSaveReplace += xts.cxevSaveReplace;
+		cxevProbeEvStatic += xts.cxevProbeEvStatic; cxevProbeEvStaticHit += xts.cxevProbeEvStaticHit;
+		return *this;
+	}
+};
+#endif
 
 
 /*
@@ -205,17 +290,13 @@ public:
 public:
 	unsigned age;
 #ifndef NOSTATS
-	/* cache stats */
-	uint64_t cxevProbe, cxevProbeHit;
-	uint64_t cxevSave, cxevSaveCollision, cxevSaveReplace, cxevInUse;
+	/* cache stats. The table is shared by all the search threads, so each 
+	   thread counts its own, and the AI adds them up when the search is done */
+	inline static thread_local XTS xtsThread;
 #endif
 
 public:
 	XT(void) : axev2(nullptr),
-#ifndef NOSTATS
-		cxevProbe(0), cxevProbeHit(0),  
-		cxevSave(0), cxevSaveCollision(0), cxevSaveReplace(0), cxevInUse(0),
-#endif
 		cxevMax(0x20000L), cxev2Max(0x10000L), shfXev2Max(17), shfXev2MaxIndex(64-17), age(0)
 	{
 	}
@@ -230,11 +311,18 @@ public:
 	/*	XT::Init
 	 *
 	 *	Initializes a new transposition table. This must be called before first use.
-	 *	Size of the cache we're allowed to use is in cbCache.
+	 *	Size of the cache we're allowed to use is in cbCache. The table is only
+	 *	reallocated if the size changes; otherwise it's just emptied.
 	 */
 	void Init(uint32_t cbCache)
 	{
-		shfXev2Max = bitscanRev(cbCache / sizeof(XEV2));
+		int shfXev2MaxNew = bitscanRev(cbCache / sizeof(XEV2));
+		if (axev2 != nullptr && shfXev2MaxNew != shfXev2Max) {
+			delete[] axev2;
+			axev2 = nullptr;
+		}
+
+		shfXev2Max = shfXev2MaxNew;
 		cxev2Max = 1 << shfXev2Max;
 		cxevMax = 2 * cxev2Max;
 		shfXev2MaxIndex = 64 - shfXev2Max;
@@ -244,20 +332,36 @@ public:
 			if (axev2 == nullptr)
 				throw 1;
 		}
-		else {
-			for (unsigned ixev2 = 0; ixev2 < cxev2Max; ixev2++) {
-				axev2[ixev2].xevDeep.SetNull();
-				axev2[ixev2].xevNew.SetNull();
-			}
-		}
+		else
+			memset(axev2, 0, (size_t)cxev2Max * sizeof(XEV2));
 
 #ifndef NOSTATS
-		cxevProbe = cxevProbeHit = 0;
-		cxevSave = cxevSaveCollision = cxevSaveReplace = 0;
-		cxevInUse = 0;
+		ClearStats();
 #endif
 	}
 
+#ifndef NOSTATS
+	void ClearStats(void) noexcept
+	{
+		xtsThread.Clear();
+	}
+
+	/*	XT::CxevInUse
+	 *
+	 *	Estimates the number of entries in use by sampling the start of the
+	 *	table. Keeping an exact count would mean every thread updating a shared
+	 *	counter on every save.
+	 */
+	uint64_t CxevInUse(void) const noexcept
+	{
+		const uint32_t cxev2Sample = min(cxev2Max, 1024U);
+		uint64_t cxevInUse = 0;
+		for (unsigned ixev2 = 0; ixev2 < cxev2Sample; ixev2++)
+			cxevInUse += (axev2[ixev2].xevDeep.tev() != tevNull) + (axev2[ixev2].xevNew.tev() != tevNull);
+		return cxevInUse * cxev2Max / cxev2Sample;
+	}
+#endif
+
 
 	/*	XT::Dage
 	 *
@@ -287,20 +391,10 @@ public:
 		/* age out really old entries */
 
 		for (unsigned ixev2 = 0; ixev2 < cxev2Max; ixev2++) {
-			if (FXevTooOld(axev2[ixev2].xevDeep)) {
-#ifndef NOSTATS
-				if (axev2[ixev2].xevDeep.tev() != tevNull)
-					cxevInUse--;
-#endif
+			if (FXevTooOld(axev2[ixev2].xevDeep))
 				axev2[ixev2].xevDeep.SetNull();
-			}
-			if (FXevTooOld(axev2[ixev2].xevNew)) {
-#ifndef NOSTATS
-				if (axev2[ixev2].xevNew.tev() != tevNull)
-					cxevInUse--;
-#endif
+			if (FXevTooOld(axev2[ixev2].xevNew))
 				axev2[ixev2].xevNew.SetNull();
-			}
 		}
 	}
 
@@ -316,99 +410,231 @@ public:
 	 *	Returns a reference to the hash table entry that may or may not be used by the
 	 *	board. Caller is responsible for making sure the entry is valid.
 	 */
-	__forceinline XEV2& operator[](const BDG& bdg) noexcept
+	__forceinline XEV2& operator[](HABD habd) noexcept
 	{
-		uint32_t ixev2 = (uint32_t)(bdg.habd >> shfXev2MaxIndex);
+		uint32_t ixev2 = (uint32_t)(habd >> shfXev2MaxIndex);
 		assert(ixev2 < cxev2Max);
 		return axev2[ixev2];
 	}
 
+	__forceinline XEV2& operator[](const BDG& bdg) noexcept
+	{
+		return (*this)[bdg.habd];
+	}
+
 
 	/*	XT::Save
 	 *
 	 *	Saves the evaluation information in the transposition table. Not guaranteed to 
-	 *	actually save the eval, using our aging heuristics.
+	 *	actually save the eval, using our aging heuristics. evStatic is the static
+	 *	eval of the board, or evInf if we don't have one.
+	 * 
+	 *	Other search threads are reading and writing the table at the same time,
+	 *	so we decide what to replace from a copy of the entry, and write the new 
+	 *	entry in one go. A torn write just fails the hash check.
 	 */
-	__declspec(noinline) XEV* Save(const BDG& bdg, const MVE& mve, TEV tev, int d, int dLim) noexcept
+	__declspec(noinline) void Save(const BDG& bdg, const MVE& mve, TEV tev, int d, int dLim, EV evStatic) noexcept
 	{	
 		assert(mve.ev != evInf && mve.ev != -evInf);
 		assert(tev != tevNull);
 #ifndef NOSTATS
-		cxevSave++;
+		xtsThread.cxevSave++;
 #endif
+		XEV xevSave;
+		xevSave.Save(bdg.habd, mve.ev, tev, d, dLim, mve, age, evStatic);
 
 		/* keep track of the deepest search */
 
 		XEV2& xev2 = (*this)[bdg];
-		XEV& xevDeep = xev2.xevDeep;
+		XEV xevDeep = xev2.xevDeep;
 		if (!(tev < xevDeep.tev()) && dLim-d >= xevDeep.dd()) {
 #ifndef NOSTATS
-			if (xevDeep.tev() == tevNull)
-				cxevInUse++;
-			else {
-				cxevSaveReplace++;
+			if (xevDeep.tev() != tevNull) {
+				xtsThread.cxevSaveReplace++;
 				if (!xevDeep.FMatchHabd(bdg.habd))
-					cxevSaveCollision++;
+					xtsThread.cxevSaveCollision++;
 			}
 #endif
-			xevDeep.Save(bdg.habd, mve.ev, tev, d, dLim, mve, age);
-			return &xevDeep;
+			xev2.xevDeep = xevSave;
+			return;
 		}
 
-		XEV& xevNew = xev2.xevNew;
+		XEV xevNew = xev2.xevNew;
 		if (!(tev < xevNew.tev())) {
 #ifndef NOSTATS
-			if (xevNew.tev() == tevNull)
-				cxevInUse++;
-			else {
-				cxevSaveReplace++;
+			if (xevNew.tev() != tevNull) {
+				xtsThread.cxevSaveReplace++;
 				if (!xevNew.FMatchHabd(bdg.habd))
-					cxevSaveCollision++;
+					xtsThread.cxevSaveCollision++;
 			}
 #endif
-			xevNew.Save(bdg.habd, mve.ev, tev, d, dLim, mve, age);
-			return &xevNew;
+			xev2.xevNew = xevSave;
 		}
-
-		return nullptr;
 	}
 
 
 	/*	XT::Find
 	 *
 	 *	Searches for the board in the transposition table, looking for an evaluation that is
-	 *	at least as deep as depth. Returns nullptr if no such entry exists.
+	 *	at least as deep as depth. Returns false if no such entry exists. The 
+	 *	board can be given by its hash, which lets us look up positions without
+	 *	actually making the move to get there.
+	 * 
+	 *	The entry is returned as a copy in xev, which is checked against the hash 
+	 *	after it's copied, so another thread writing the entry while we're 
+	 *	looking at it can't hand us a mix of two different entries.
 	 */
-	__declspec(noinline) XEV* Find(const BDG& bdg, int d, int dLim) noexcept
+	__declspec(noinline) bool FFind(HABD habd, int d, int dLim, XEV& xev) noexcept
 	{
 #ifndef NOSTATS
-		cxevProbe++;
+		xtsThread.cxevProbe++;
 #endif
-		XEV2& xev2 = (*this)[bdg];
-		XEV& xevDeep = xev2.xevDeep;
-		if (xevDeep.FMatchHabd(bdg.habd) && dLim-d <= xevDeep.dd()) {
+		XEV2& xev2 = (*this)[habd];
+		xev = xev2.xevDeep;
+		if (xev.FMatchHabd(habd) && dLim-d <= xev.dd()) {
 #ifndef NOSTATS
-			cxevProbeHit++;
+			xtsThread.cxevProbeHit++;
 #endif
-			xevDeep.SetAge(age);
-			return &xevDeep;
+			if (xev.age() != age)
+				xev2.xevDeep = XevAged(xev, habd);
+			return true;
 		}
 
-		XEV& xevNew = xev2.xevNew;
-		if (xevNew.FMatchHabd(bdg.habd) && dLim-d <= xevNew.dd()) {
+		xev = xev2.xevNew;
+		if (xev.FMatchHabd(habd) && dLim-d <= xev.dd()) {
 #ifndef NOSTATS
-			cxevProbeHit++;
+			xtsThread.cxevProbeHit++;
 #endif
-			xevNew.SetAge(age);
-			return &xevNew;
+			if (xev.age() != age)
+				xev2.xevNew = XevAged(xev, habd);
+			return true;
 		}
-		return nullptr;
+		return false;
 	}
 
-	__forceinline void Prefetch(const BDG& bdg)
+	__forceinline bool FFind(const BDG& bdg, int d, int dLim, XEV& xev) noexcept
+	{
+		return FFind(bdg.habd, d, dLim, xev);
+	}
+
+	__forceinline XEV XevAged(XEV xev, HABD habd) const noexcept
+	{
+		xev.SetAge(age);
+		xev.SetHabd(habd);
+		return xev;
+	}
+
+	/*	XT::FFindEvStatic
+	 *
+	 *	Looks for a saved static eval of the board, regardless of the depth of
+	 *	the entry it's in. Returns true and the eval in evStatic if we find one.
+	 */
+	__forceinline bool FFindEvStatic(const BDG& bdg, EV& evStatic) noexcept
+	{
+#ifndef NOSTATS
+		xtsThread.cxevProbeEvStatic++;
+#endif
+		XEV2& xev2 = (*this)[bdg];
+		XEV xev = xev2.xevDeep;
+		if (!xev.FMatchHabd(bdg.habd) || !xev.FHasEvStatic()) {
+			xev = xev2.xevNew;
+			if (!xev.FMatchHabd(bdg.habd) || !xev.FHasEvStatic())
+				return false;
+		}
+#ifndef NOSTATS
+		xtsThread.cxevProbeEvStaticHit++;
+#endif
+		evStatic = xev.evStatic();
+		return true;
+	}
+
+	__forceinline void Prefetch(HABD habd)
 	{
-		XEV2* pxev2 = &(*this)[bdg];
+		XEV2* pxev2 = &(*this)[habd];
 		_mm_prefetch((char*)pxev2, _MM_HINT_T0);
 	}
+
+	__forceinline void Prefetch(const BDG& bdg)
+	{
+		Prefetch(bdg.habd);
+	}
+
+	/* saving and loading to disk */
+
+	void SaveFile(const wstring& szFile) const;
+	void LoadFile(const wstring& szFile);
  };
 
+
+
+/*
+ *
+ *	EVC
+ * 
+ *	The static evaluation cache. Static evals are expensive, and quiescent search
+ *	keeps evaluating the same positions over and over again, so we keep a small
+ *	direct-mapped cache of evals indexed by the board hash. It's sized to fit in
+ *	the L2 cache.
+ * 
+ *	Each entry packs the high 48 bits of the board hash with the biased 16-bit 
+ *	eval. The low bits of the hash are used as the index, so we end up checking 
+ *	almost the entire hash. A biased eval is never zero, so empty entries never 
+ *	match.
+ * 
+ */
+
+
+class EVC
+{
+	static const uint32_t cevcMax = 0x8000;	/* 32K entries, 256KB */
+	uint64_t* aevc;
+
+public:
+#ifndef NOSTATS
+	uint64_t cevcProbe, cevcProbeHit;
+#endif
+
+public:
+	EVC(void) : aevc(nullptr)
+#ifndef NOSTATS
+		, cevcProbe(0), cevcProbeHit(0)
+#endif
+	{
+		aevc = new uint64_t[cevcMax];
+		Clear();
+	}
+
+	~EVC(void)
+	{
+		delete[] aevc;
+	}
+
+	void Clear(void) noexcept
+	{
+		memset(aevc, 0, cevcMax * sizeof(uint64_t));
+#ifndef NOSTATS
+		cevcProbe = cevcProbeHit = 0;
+#endif
+	}
+
+	__forceinline bool FFind(const BDG& bdg, EV& ev) noexcept
+	{
+#ifndef NOSTATS
+		cevcProbe++;
+#endif
+		uint64_t evc = aevc[bdg.habd & (cevcMax - 1)];
+		if (((evc ^ bdg.habd) & ~0xffffULL) != 0 || (evc & 0xffff) == 0)
+			return false;
+#ifndef NOSTATS
+		cevcProbeHit++;
+#endif
+		ev = static_cast<EV>(evc & 0xffff) - evBias;
+		return true;
+	}
+
+	__forceinline void Save(const BDG& bdg, EV ev) noexcept
+	{
+		assert(ev < evInf && ev > -evInf);
+		aevc[bdg.habd & (cevcMax - 1)] = (bdg.habd & ~0xffffULL) | static_cast<uint16_t>(ev + evBias);
+	}
+};